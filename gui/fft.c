@@ -18,14 +18,35 @@
 
 #include <fftw3.h>
 #include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "../src/stats.h"
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
 #ifndef MIN
 #define MIN(A, B) ((A) < (B) ? (A) : (B))
 #endif
+#ifndef MAX
+#define MAX(A, B) ((A) > (B) ? (A) : (B))
+#endif
 
+/* fftw_planner_lock only serializes planning in this copy of fft.c,
+ * the DSP and GUI each have their own, see ft_planner_init() */
 static pthread_mutex_t fftw_planner_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t window_cache_lock = PTHREAD_MUTEX_INITIALIZER;
 static unsigned int    instance_count    = 0;
 
 typedef enum {
@@ -37,6 +58,34 @@ typedef enum {
 	W_FLAT_TOP
 } window_t;
 
+/* averaging of the power spectrum across analysis frames */
+typedef enum {
+	AVG_NONE = 0,
+	AVG_EXP,   /* exponential, time-constant of n frames */
+	AVG_LIN    /* linear (Welch), mean of n frames */
+} avg_t;
+
+/* decimation by two, half-band FIR, see ft_decimate() */
+#define FT_HB_TAPS (31)
+#define FT_DEC_BLOCK (1024)
+
+struct FFTDecimator {
+	uint32_t n_chn;
+	uint32_t phase;
+	float*   buf; /* filter history and input, per channel */
+	float*   out; /* FT_DEC_BLOCK / 2 per channel */
+	float    coeff[FT_HB_TAPS];
+};
+
+/* window function table, shared by all analyses of the same type and size */
+struct FFTWindow {
+	window_t          type;
+	uint32_t          size;
+	uint32_t          refcount;
+	float*            data;
+	struct FFTWindow* next;
+};
+
 /******************************************************************************
  * internal FFT abstraction
  */
@@ -44,23 +93,43 @@ struct FFTAnalysis {
 	uint32_t   window_size;
 	window_t   window_type;
 	uint32_t   data_size;
+	uint32_t   n_channels;
+	uint32_t   n_traces;
 	double     rate;
 	double     freq_per_bin;
 	double     phasediff_step;
-	float*     window;
+	struct FFTWindow* window;
 	float*     fft_in;
 	float*     fft_out;
+	float*     fft_out_h; /* previous fft_out, for phase differences */
 	float*     power;
-	float*     phase;
-	float*     phase_h;
-	fftwf_plan fftplan;
+	float*     power_frame; /* current frame, when averaging */
+	float*     power_sum;   /* AVG_LIN accumulator */
+	avg_t      avg_mode;
+	uint32_t   avg_n;
+	uint32_t   avg_cnt;
+	uint32_t   overlap;     /* 0: (rate / fps), else window_size / overlap */
+	uint32_t   sps_fps;
+	float*     peak;        /* peak-hold power, see ft_peak() */
+	float*     peak_age;    /* samples since the peak was set */
+	uint32_t   peak_step;   /* samples since the last update */
+	bool       peak_on;
+	float      peak_hold;   /* seconds, INFINITY: forever */
+	float      peak_decay;  /* dB/sec after the hold time, INFINITY: release */
+	fftwf_plan fftplan; /* shared, see ft_plan() */
+	SpectraHist* t_analyze; /* optional, time spent in ft_analyze() */
 
-	float*   ringbuf;
+	float*   ringbuf; /* mirrored, 2 * window_size per channel */
 	uint32_t rboff;
 	uint32_t smps;
 	uint32_t sps;
 	uint32_t step;
 	double   phasediff_bin;
+
+	/* multi-resolution: the next stage analyzes the input,
+	 * decimated by two, see fftx_init_stages() */
+	struct FFTAnalysis* sub;
+	struct FFTDecimator dec;
 };
 
 /* ****************************************************************************
@@ -117,66 +186,556 @@ ft_flattop (float* window, uint32_t n)
 
 
 /* ****************************************************************************
- * internal private functions
+ * plan cache
+ *
+ * FFTW_MEASURE planning can take seconds for large sizes. Plans are shared
+ * by all instances of this copy of fft.c (the DSP and the GUI each have one)
+ * and kept until it is unloaded, also when no instance is left, so that
+ * re-opening a UI does not plan again. The analysis uses fftwf_execute_r2r()
+ * (or fftwf_execute_dft()) on each instance's buffers.
+ * Wisdom is loaded from (and saved to) a per-user cache file.
  */
-static float*
-ft_gen_window (struct FFTAnalysis* ft)
+struct FFTPlan {
+	uint32_t        window_size;
+	uint32_t        n_channels;
+	bool            cplx;
+	fftwf_plan      plan;
+	struct FFTPlan* next;
+};
+
+static struct FFTPlan* plan_cache    = NULL;
+static bool            wisdom_loaded = false;
+
+static bool
+ft_wisdom_file (char* path, size_t len)
+{
+#ifdef _WIN32
+	const char* cache = getenv ("LOCALAPPDATA");
+	if (!cache) {
+		return false;
+	}
+	snprintf (path, len, "%s\\x42-spectr-fftwf.wisdom", cache);
+#else
+	const char* cache = getenv ("XDG_CACHE_HOME");
+	const char* home  = getenv ("HOME");
+	if (cache && *cache) {
+		snprintf (path, len, "%s/x42-spectr-fftwf.wisdom", cache);
+	} else if (home && *home) {
+		snprintf (path, len, "%s/.cache/x42-spectr-fftwf.wisdom", home);
+	} else {
+		return false;
+	}
+#endif
+	return true;
+}
+
+/** fft.c is compiled into both the DSP and the GUI, which may plan
+ * concurrently in the same process (worker and analysis builder thread).
+ * Have libfftw3f serialize all planning, once before the first plan.
+ * fftw_planner_lock must be held */
+static void
+ft_planner_init (void)
 {
-	if (ft->window) {
-		return ft->window;
+#ifdef HAVE_FFTW335
+	static bool thread_safe = false;
+	if (!thread_safe) {
+		fftwf_make_planner_thread_safe ();
+		thread_safe = true;
+	}
+#endif
+}
+
+/** write wisdom to a temporary file, and atomically replace the cache file.
+ * The DSP and GUI (each with their own copy of fft.c), as well as other
+ * processes, may export concurrently. */
+static void
+ft_wisdom_export (const char* path)
+{
+	/* unique per process and per copy of fft.c */
+	char tmp[1080];
+	snprintf (tmp, sizeof (tmp), "%s.%d.%p", path, (int)getpid (), (void*)&plan_cache);
+	if (!fftwf_export_wisdom_to_filename (tmp)) {
+		remove (tmp);
+		return;
+	}
+#ifdef _WIN32
+	/* rename() does not replace existing files */
+	remove (path);
+#endif
+	if (rename (tmp, path)) {
+		remove (tmp);
+	}
+}
+
+/** look up or create a batched r2hc (or complex) plan,
+ * fftw_planner_lock must be held */
+static fftwf_plan
+ft_plan (uint32_t window_size, uint32_t n_channels, bool cplx)
+{
+	ft_planner_init ();
+
+	for (struct FFTPlan* p = plan_cache; p; p = p->next) {
+		if (p->window_size == window_size && p->n_channels == n_channels && p->cplx == cplx) {
+			return p->plan;
+		}
 	}
 
-	ft->window = (float*)malloc (sizeof (float) * ft->window_size);
+	char       path[1024];
+	const bool use_wisdom = ft_wisdom_file (path, sizeof (path));
+
+	if (use_wisdom && !wisdom_loaded) {
+		fftwf_import_wisdom_from_filename (path);
+		wisdom_loaded = true;
+	}
+
+	/* plan using temporary buffers (FFTW_MEASURE overwrites them),
+	 * fftwf_malloc() guarantees the same alignment for all arrays */
+	const int            n     = window_size;
+	const fftwf_r2r_kind kind  = FFTW_R2HC;
+	const size_t         bsize = (cplx ? sizeof (fftwf_complex) : sizeof (float)) * window_size * n_channels;
+	float*               in    = (float*)fftwf_malloc (bsize);
+	float*               out   = (float*)fftwf_malloc (bsize);
+
+	/* one batched plan for all channels, contiguous in fft_in/out */
+	fftwf_plan plan;
+	if (cplx) {
+		plan = fftwf_plan_many_dft (1, &n, n_channels,
+		                            (fftwf_complex*)in, NULL, 1, window_size,
+		                            (fftwf_complex*)out, NULL, 1, window_size,
+		                            FFTW_FORWARD, FFTW_MEASURE);
+	} else {
+		plan = fftwf_plan_many_r2r (1, &n, n_channels,
+		                            in, NULL, 1, window_size,
+		                            out, NULL, 1, window_size,
+		                            &kind, FFTW_MEASURE);
+	}
+	fftwf_free (in);
+	fftwf_free (out);
+
+	struct FFTPlan* p = plan ? (struct FFTPlan*)malloc (sizeof (struct FFTPlan)) : NULL;
+	if (!p) {
+		return plan;
+	}
+	p->window_size = window_size;
+	p->n_channels  = n_channels;
+	p->cplx        = cplx;
+	p->plan        = plan;
+	p->next        = plan_cache;
+	plan_cache     = p;
+
+	if (use_wisdom) {
+		ft_wisdom_export (path);
+	}
+	return plan;
+}
+
+/** destroy all cached plans, fftw_planner_lock must be held */
+static void
+ft_plan_cache_clear (void)
+{
+	while (plan_cache) {
+		struct FFTPlan* p = plan_cache;
+		plan_cache        = p->next;
+		fftwf_destroy_plan (p->plan);
+		free (p);
+	}
+}
+
+/** drop an instance's reference, fftw_planner_lock must be held */
+static void
+ft_plan_release (void)
+{
+	if (instance_count > 0) {
+		--instance_count;
+	}
+#ifdef WITH_STATIC_FFTW_CLEANUP
+	/* use this only when statically linking to a local fftw!
+	 *
+	 * "After calling fftw_cleanup, all existing plans become undefined,
+	 *  and you should not attempt to execute them nor to destroy them."
+	 * [http://www.fftw.org/fftw3_doc/Using-Plans.html]
+	 *
+	 * If libfftwf is shared with other plugins or the host this can
+	 * cause undefined behavior.
+	 */
+	if (instance_count == 0) {
+		ft_plan_cache_clear ();
+		fftwf_cleanup ();
+		wisdom_loaded = false;
+	}
+#endif
+}
+
+#ifndef WITH_STATIC_FFTW_CLEANUP
+/** free cached plans when the plugin or UI is unloaded */
+__attribute__ ((destructor)) static void
+ft_plan_unload (void)
+{
+	pthread_mutex_lock (&fftw_planner_lock);
+	ft_plan_cache_clear ();
+	pthread_mutex_unlock (&fftw_planner_lock);
+}
+#endif
+
+/* ****************************************************************************
+ * window cache
+ *
+ * Tables are reference counted and computed when an analysis is created,
+ * or the window-type is changed, never when processing data.
+ */
+static struct FFTWindow* window_cache = NULL;
+
+static void
+ft_gen_window (float* window, window_t type, uint32_t n)
+{
 	double sum = .0;
 
 	/* https://en.wikipedia.org/wiki/Window_function */
-	switch (ft->window_type) {
+	switch (type) {
 		default:
 		case W_HANN:
-			sum = ft_hannhamm (ft->window, ft->window_size, .5, .5);
+			sum = ft_hannhamm (window, n, .5, .5);
 			break;
 		case W_HAMMMIN:
-			sum = ft_hannhamm (ft->window, ft->window_size, .54, .46);
+			sum = ft_hannhamm (window, n, .54, .46);
 			break;
 		case W_NUTTALL:
-			sum = ft_bnh (ft->window, ft->window_size, .355768, .487396, .144232, .012604);
+			sum = ft_bnh (window, n, .355768, .487396, .144232, .012604);
 			break;
 		case W_BLACKMAN_NUTTALL:
-			sum = ft_bnh (ft->window, ft->window_size, .3635819, .4891775, .1365995, .0106411);
+			sum = ft_bnh (window, n, .3635819, .4891775, .1365995, .0106411);
 			break;
 		case W_BLACKMAN_HARRIS:
-			sum = ft_bnh (ft->window, ft->window_size, .35875, .48829, .14128, .01168);
+			sum = ft_bnh (window, n, .35875, .48829, .14128, .01168);
 			break;
 		case W_FLAT_TOP:
-			sum = ft_flattop (ft->window, ft->window_size);
+			sum = ft_flattop (window, n);
 			break;
 	}
 
 	const double isum = 2.0 / sum;
-	for (uint32_t i = 0; i < ft->window_size; i++) {
-		ft->window[i] *= isum;
+	for (uint32_t i = 0; i < n; i++) {
+		window[i] *= isum;
+	}
+}
+
+/** get a reference to the window table of given type and size */
+static struct FFTWindow*
+fftx_window_acquire (window_t type, uint32_t size)
+{
+	pthread_mutex_lock (&window_cache_lock);
+	struct FFTWindow* w;
+	for (w = window_cache; w; w = w->next) {
+		if (w->type == type && w->size == size) {
+			++w->refcount;
+			pthread_mutex_unlock (&window_cache_lock);
+			return w;
+		}
+	}
+
+	w = (struct FFTWindow*)malloc (sizeof (struct FFTWindow));
+	if (w && !(w->data = (float*)malloc (sizeof (float) * size))) {
+		free (w);
+		w = NULL;
+	}
+	if (w) {
+		ft_gen_window (w->data, type, size);
+		w->type      = type;
+		w->size      = size;
+		w->refcount  = 1;
+		w->next      = window_cache;
+		window_cache = w;
+	}
+	pthread_mutex_unlock (&window_cache_lock);
+	return w;
+}
+
+static void
+fftx_window_release (struct FFTWindow* w)
+{
+	if (!w) {
+		return;
+	}
+	pthread_mutex_lock (&window_cache_lock);
+	if (--w->refcount == 0) {
+		struct FFTWindow** p = &window_cache;
+		while (*p != w) {
+			p = &(*p)->next;
+		}
+		*p = w->next;
+		free (w->data);
+		free (w);
+	}
+	pthread_mutex_unlock (&window_cache_lock);
+}
+
+/* ****************************************************************************
+ * half-band decimation
+ *
+ * Blackman windowed sinc, every other tap is zero. The pass-band is flat
+ * up to half of the output's Nyquist frequency, and aliases into it
+ * are suppressed by > 75dB. Only that part of a decimated signal is used,
+ * see fftx_stage_range() and fftz_range().
+ */
+
+static void
+ft_decimator_init (struct FFTDecimator* dec, uint32_t n_chn)
+{
+	const int c   = FT_HB_TAPS / 2;
+	double    sum = 0;
+	for (int i = 0; i < FT_HB_TAPS; ++i) {
+		const int    m = i - c;
+		const double w = .42 - .5 * cos (2. * M_PI * i / (FT_HB_TAPS - 1.)) + .08 * cos (4. * M_PI * i / (FT_HB_TAPS - 1.));
+		const double h = m == 0 ? .5 : (m & 1) ? sin (M_PI * m / 2.) / (M_PI * m) : 0;
+		dec->coeff[i]  = h * w;
+		sum += h * w;
+	}
+	for (int i = 0; i < FT_HB_TAPS; ++i) {
+		dec->coeff[i] /= sum;
+	}
+	dec->n_chn = n_chn;
+	dec->phase = 0;
+	dec->buf   = (float*)calloc ((FT_HB_TAPS - 1 + FT_DEC_BLOCK) * n_chn, sizeof (float));
+	dec->out   = (float*)calloc (FT_DEC_BLOCK / 2 * n_chn, sizeof (float));
+}
+
+static void
+ft_decimator_reset (struct FFTDecimator* dec)
+{
+	memset (dec->buf, 0, (FT_HB_TAPS - 1 + FT_DEC_BLOCK) * dec->n_chn * sizeof (float));
+	dec->phase = 0;
+}
+
+static void
+ft_decimator_free (struct FFTDecimator* dec)
+{
+	free (dec->buf);
+	free (dec->out);
+	dec->buf = NULL;
+	dec->out = NULL;
+}
+
+/** decimate n_samples <= FT_DEC_BLOCK of every channel by two,
+ * into dec->out. returns the number of samples per channel
+ */
+static uint32_t
+ft_decimate (struct FFTDecimator* dec, float const* const* data, const uint32_t n_samples)
+{
+	const uint32_t nh    = FT_HB_TAPS - 1;
+	float const*   h     = dec->coeff;
+	uint32_t       n_out = 0;
+
+	for (uint32_t c = 0; c < dec->n_chn; ++c) {
+		float* buf = &dec->buf[c * (nh + FT_DEC_BLOCK)];
+		float* out = &dec->out[c * FT_DEC_BLOCK / 2];
+		memcpy (&buf[nh], data[c], n_samples * sizeof (float));
+		n_out = 0;
+		for (uint32_t i = dec->phase; i < n_samples; i += 2) {
+			/* filter input is buf[i] .. buf[i + nh], only odd taps are non-zero */
+			float const* x = &buf[i];
+			float        y = h[nh / 2] * x[nh / 2];
+			for (uint32_t j = 0; j < nh / 2; j += 2) {
+				y += h[j] * (x[j] + x[nh - j]);
+			}
+			out[n_out++] = y;
+		}
+		memmove (buf, &buf[n_samples], nh * sizeof (float));
+	}
+	dec->phase = (dec->phase + n_samples) & 1;
+	return n_out;
+}
+
+/* ****************************************************************************
+ * internal private functions
+ */
+/** power spectrum of half-complex FFT output */
+static void
+ft_power (float* power, float const* out, const uint32_t n_siz, const uint32_t d_siz)
+{
+	power[0] = out[0] * out[0];
+
+	uint32_t i = 1;
+#ifdef __SSE__
+	for (; i + 4 < d_siz; i += 4) {
+		/* imaginary part is stored in reverse order: out[n_siz - i] */
+		const __m128 re = _mm_loadu_ps (&out[i]);
+		const __m128 ir = _mm_loadu_ps (&out[n_siz - i - 3]);
+		const __m128 im = _mm_shuffle_ps (ir, ir, _MM_SHUFFLE (0, 1, 2, 3));
+		_mm_storeu_ps (&power[i], _mm_add_ps (_mm_mul_ps (re, re), _mm_mul_ps (im, im)));
 	}
+#endif
+	for (; i < d_siz - 1; ++i) {
+		power[i] = (out[i] * out[i]) + (out[n_siz - i] * out[n_siz - i]);
+	}
+}
+
+/** power spectra of mid (L + R) / 2 and side (L - R) / 2.
+ * The transform is linear, so this can be computed in the frequency domain.
+ */
+static void
+ft_power_ms (float* p_m, float* p_s, float const* lft, float const* rgt, const uint32_t n_siz, const uint32_t d_siz)
+{
+	p_m[0] = .25f * (lft[0] + rgt[0]) * (lft[0] + rgt[0]);
+	p_s[0] = .25f * (lft[0] - rgt[0]) * (lft[0] - rgt[0]);
 
-	return ft->window;
+	uint32_t i = 1;
+#ifdef __SSE__
+	const __m128 q = _mm_set1_ps (.25f);
+	for (; i + 4 < d_siz; i += 4) {
+		const __m128 l_re = _mm_loadu_ps (&lft[i]);
+		const __m128 r_re = _mm_loadu_ps (&rgt[i]);
+		const __m128 l_ir = _mm_loadu_ps (&lft[n_siz - i - 3]);
+		const __m128 r_ir = _mm_loadu_ps (&rgt[n_siz - i - 3]);
+		const __m128 l_im = _mm_shuffle_ps (l_ir, l_ir, _MM_SHUFFLE (0, 1, 2, 3));
+		const __m128 r_im = _mm_shuffle_ps (r_ir, r_ir, _MM_SHUFFLE (0, 1, 2, 3));
+		const __m128 m_re = _mm_add_ps (l_re, r_re);
+		const __m128 m_im = _mm_add_ps (l_im, r_im);
+		const __m128 s_re = _mm_sub_ps (l_re, r_re);
+		const __m128 s_im = _mm_sub_ps (l_im, r_im);
+		_mm_storeu_ps (&p_m[i], _mm_mul_ps (q, _mm_add_ps (_mm_mul_ps (m_re, m_re), _mm_mul_ps (m_im, m_im))));
+		_mm_storeu_ps (&p_s[i], _mm_mul_ps (q, _mm_add_ps (_mm_mul_ps (s_re, s_re), _mm_mul_ps (s_im, s_im))));
+	}
+#endif
+	for (; i < d_siz - 1; ++i) {
+		const float m_re = lft[i] + rgt[i];
+		const float m_im = lft[n_siz - i] + rgt[n_siz - i];
+		const float s_re = lft[i] - rgt[i];
+		const float s_im = lft[n_siz - i] - rgt[n_siz - i];
+		p_m[i]           = .25f * ((m_re * m_re) + (m_im * m_im));
+		p_s[i]           = .25f * ((s_re * s_re) + (s_im * s_im));
+	}
 }
 
+/** complex value of bin b of trace t (channel, or mid/side) */
 static void
+ft_bin (struct FFTAnalysis* ft, float const* out, const uint32_t t, const uint32_t b, float* re, float* im)
+{
+	const uint32_t n_siz = ft->window_size;
+	if (t < ft->n_channels) {
+		*re = out[t * n_siz + b];
+		*im = b > 0 ? out[t * n_siz + n_siz - b] : 0;
+	} else {
+		/* mid: (L + R) / 2, side: (L - R) / 2 */
+		const float g = t == 2 ? .5f : -.5f;
+		*re           = .5f * out[b] + g * out[n_siz + b];
+		*im           = b > 0 ? .5f * out[n_siz - b] + g * out[2 * n_siz - b] : 0;
+	}
+}
+
+/** combine the power of the current frame with previous ones,
+ * returns true if ft->power was updated */
+static bool
+ft_average (struct FFTAnalysis* ft)
+{
+	const uint32_t n = ft->data_size * ft->n_traces;
+	float* const   p = ft->power;
+	float* const   f = ft->power_frame;
+
+	switch (ft->avg_mode) {
+		case AVG_EXP: {
+			const float a = 1.f / ft->avg_n;
+			for (uint32_t i = 0; i < n; ++i) {
+				p[i] += a * (f[i] - p[i]);
+			}
+		} break;
+		case AVG_LIN: {
+			float* const s = ft->power_sum;
+			for (uint32_t i = 0; i < n; ++i) {
+				s[i] += f[i];
+			}
+			if (++ft->avg_cnt < ft->avg_n) {
+				return false;
+			}
+			const float a = 1.f / ft->avg_n;
+			for (uint32_t i = 0; i < n; ++i) {
+				p[i] = a * s[i];
+				s[i] = 0;
+			}
+			ft->avg_cnt = 0;
+		} break;
+		default:
+			break;
+	}
+	return true;
+}
+
+/** update peak-hold from the current power.
+ * Peaks are held for peak_hold seconds, then fall back
+ * with peak_decay dB/sec. */
+static void
+ft_peak (struct FFTAnalysis* ft)
+{
+	const uint32_t n     = ft->data_size * ft->n_traces;
+	const float    step  = ft->peak_step;
+	const float    hold  = ft->peak_hold * ft->rate;
+	const float    coeff = isinf (ft->peak_decay) ? 0.f : powf (10.f, -.1f * ft->peak_decay * step / ft->rate);
+	float const*   p     = ft->power;
+	float* const   pk    = ft->peak;
+	float* const   age   = ft->peak_age;
+
+	uint32_t i = 0;
+#ifdef __SSE__
+	const __m128 vs = _mm_set1_ps (step);
+	const __m128 vh = _mm_set1_ps (hold);
+	const __m128 vc = _mm_set1_ps (coeff);
+	for (; i + 4 <= n; i += 4) {
+		const __m128 vp  = _mm_loadu_ps (&p[i]);
+		const __m128 vk  = _mm_loadu_ps (&pk[i]);
+		const __m128 up  = _mm_cmpge_ps (vp, vk);
+		const __m128 va  = _mm_andnot_ps (up, _mm_add_ps (_mm_loadu_ps (&age[i]), vs));
+		const __m128 rel = _mm_cmpgt_ps (va, vh);
+		const __m128 dk  = _mm_max_ps (vp, _mm_mul_ps (vk, vc));
+		_mm_storeu_ps (&pk[i], _mm_or_ps (_mm_and_ps (rel, dk), _mm_andnot_ps (rel, _mm_max_ps (vp, vk))));
+		_mm_storeu_ps (&age[i], va);
+	}
+#endif
+	for (; i < n; ++i) {
+		if (p[i] >= pk[i]) {
+			pk[i]  = p[i];
+			age[i] = 0;
+			continue;
+		}
+		age[i] += step;
+		if (age[i] > hold) {
+			pk[i] = MAX (p[i], pk[i] * coeff);
+		}
+	}
+}
+
+/** analyze fft_in, returns true if ft->power was updated */
+static bool
 ft_analyze (struct FFTAnalysis* ft)
 {
-	fftwf_execute (ft->fftplan);
+	/* keep the previous result, phase is only computed on demand */
+	float* tmp    = ft->fft_out_h;
+	ft->fft_out_h = ft->fft_out;
+	ft->fft_out   = tmp;
 
-	memcpy (ft->phase_h, ft->phase, sizeof (float) * ft->data_size);
-	ft->power[0] = ft->fft_out[0] * ft->fft_out[0];
-	ft->phase[0] = 0;
+	/* all channels are transformed in one go */
+	fftwf_execute_r2r (ft->fftplan, ft->fft_in, ft->fft_out);
+
+	const uint32_t n_siz = ft->window_size;
+	const uint32_t d_siz = ft->data_size;
+	float* const   power = ft->avg_mode == AVG_NONE ? ft->power : ft->power_frame;
+
+	for (uint32_t c = 0; c < ft->n_channels; ++c) {
+		ft_power (&power[c * d_siz], &ft->fft_out[c * n_siz], n_siz, d_siz);
+	}
 
-#define FRe (ft->fft_out[i])
-#define FIm (ft->fft_out[ft->window_size - i])
-	for (uint32_t i = 1; i < ft->data_size - 1; ++i) {
-		ft->power[i] = (FRe * FRe) + (FIm * FIm);
-		ft->phase[i] = atan2f (FIm, FRe);
+	if (ft->n_traces > ft->n_channels) {
+		assert (ft->n_channels == 2 && ft->n_traces == 4);
+		ft_power_ms (&power[2 * d_siz], &power[3 * d_siz], &ft->fft_out[0], &ft->fft_out[n_siz], n_siz, d_siz);
 	}
-#undef FRe
-#undef FIm
+
+	ft->peak_step += ft->step;
+	if (!ft_average (ft)) {
+		return false;
+	}
+	if (ft->peak_on) {
+		ft_peak (ft);
+	}
+	ft->peak_step = 0;
+	return true;
 }
 
 /******************************************************************************
@@ -190,48 +749,79 @@ FFTX_FN_PREFIX
 void
 fftx_reset (struct FFTAnalysis* ft)
 {
-	for (uint32_t i = 0; i < ft->data_size; ++i) {
-		ft->power[i]   = 0;
-		ft->phase[i]   = 0;
-		ft->phase_h[i] = 0;
+	for (uint32_t i = 0; i < ft->data_size * ft->n_traces; ++i) {
+		ft->power[i]       = 0;
+		ft->power_frame[i] = 0;
+		ft->power_sum[i]   = 0;
 	}
-	for (uint32_t i = 0; i < ft->window_size; ++i) {
-		ft->ringbuf[i] = 0;
-		ft->fft_out[i] = 0;
+	ft->avg_cnt = 0;
+	memset (ft->peak, 0, ft->data_size * ft->n_traces * sizeof (float));
+	memset (ft->peak_age, 0, ft->data_size * ft->n_traces * sizeof (float));
+	for (uint32_t i = 0; i < ft->window_size * ft->n_channels; ++i) {
+		ft->fft_out[i]   = 0;
+		ft->fft_out_h[i] = 0;
 	}
+	memset (ft->ringbuf, 0, 2 * ft->window_size * ft->n_channels * sizeof (float));
 	ft->rboff = 0;
 	ft->smps  = 0;
 	ft->step  = 0;
+	if (ft->sub) {
+		ft_decimator_reset (&ft->dec);
+		fftx_reset (ft->sub);
+	}
 }
 
+/** initialize analysis of n_channels,
+ * stereo analysis adds mid and side traces (index 2, 3)
+ */
 FFTX_FN_PREFIX
 void
-fftx_init (struct FFTAnalysis* ft, uint32_t window_size, double rate, double fps)
+fftx_init (struct FFTAnalysis* ft, uint32_t window_size, uint32_t n_channels, double rate, double fps)
 {
 	ft->rate           = rate;
 	ft->window_size    = window_size;
 	ft->window_type    = W_HANN;
 	ft->data_size      = window_size / 2;
-	ft->window         = NULL;
+	ft->n_channels     = n_channels;
+	ft->n_traces       = n_channels == 2 ? 4 : n_channels;
+	ft->window         = fftx_window_acquire (W_HANN, window_size);
 	ft->rboff          = 0;
 	ft->smps           = 0;
 	ft->step           = 0;
-	ft->sps            = (fps > 0) ? ceil (rate / fps) : 0;
+	/* with large windows, limit the fps-based overlap to 87.5% */
+	ft->sps            = (fps > 0) ? MAX (ceil (rate / fps), window_size / 8) : 0;
+	ft->sps_fps        = ft->sps;
+	ft->overlap        = 0;
+	ft->avg_mode       = AVG_NONE;
+	ft->avg_n          = 1;
+	ft->avg_cnt        = 0;
+	ft->peak_on        = false;
+	ft->peak_step      = 0;
+	ft->peak_hold      = INFINITY;
+	ft->peak_decay     = 0;
 	ft->freq_per_bin   = ft->rate / ft->data_size / 2.f;
 	ft->phasediff_step = M_PI / ft->data_size;
 	ft->phasediff_bin  = 0;
+	ft->t_analyze      = NULL;
+	ft->sub            = NULL;
+	ft->dec.buf        = NULL;
+	ft->dec.out        = NULL;
+
+	ft->ringbuf = (float*)malloc (2 * window_size * n_channels * sizeof (float));
+	ft->fft_in  = (float*)fftwf_malloc (sizeof (float) * window_size * n_channels);
+	ft->fft_out = (float*)fftwf_malloc (sizeof (float) * window_size * n_channels);
+	ft->power   = (float*)malloc (ft->data_size * ft->n_traces * sizeof (float));
 
-	ft->ringbuf = (float*)malloc (window_size * sizeof (float));
-	ft->fft_in  = (float*)fftwf_malloc (sizeof (float) * window_size);
-	ft->fft_out = (float*)fftwf_malloc (sizeof (float) * window_size);
-	ft->power   = (float*)malloc (ft->data_size * sizeof (float));
-	ft->phase   = (float*)malloc (ft->data_size * sizeof (float));
-	ft->phase_h = (float*)malloc (ft->data_size * sizeof (float));
+	ft->power_frame = (float*)malloc (ft->data_size * ft->n_traces * sizeof (float));
+	ft->power_sum   = (float*)malloc (ft->data_size * ft->n_traces * sizeof (float));
+	ft->peak        = (float*)malloc (ft->data_size * ft->n_traces * sizeof (float));
+	ft->peak_age    = (float*)malloc (ft->data_size * ft->n_traces * sizeof (float));
+	ft->fft_out_h = (float*)fftwf_malloc (sizeof (float) * window_size * n_channels);
 
 	fftx_reset (ft);
 
 	pthread_mutex_lock (&fftw_planner_lock);
-	ft->fftplan = fftwf_plan_r2r_1d (window_size, ft->fft_in, ft->fft_out, FFTW_R2HC, FFTW_MEASURE);
+	ft->fftplan = ft_plan (window_size, n_channels, false);
 	++instance_count;
 	pthread_mutex_unlock (&fftw_planner_lock);
 }
@@ -243,9 +833,144 @@ fftx_set_window (struct FFTAnalysis* ft, window_t type)
 	if (ft->window_type == type) {
 		return;
 	}
+	/* this is cheap if the table is already in use, see fftx_window_acquire() */
+	struct FFTWindow* w = fftx_window_acquire (type, ft->window_size);
+	if (!w) {
+		return;
+	}
+	fftx_window_release (ft->window);
+	ft->window      = w;
 	ft->window_type = type;
-	free (ft->window);
-	ft->window = NULL;
+	if (ft->sub) {
+		fftx_set_window (ft->sub, type);
+	}
+}
+
+/** add stages for a multi-resolution analysis.
+ *
+ * Every stage analyzes the input of the previous one decimated by two,
+ * with the same window-size, and hence twice the frequency resolution
+ * and half the time resolution. see fftx_stage_range().
+ *
+ * This allocates memory, call it after fftx_init(), before use.
+ */
+FFTX_FN_PREFIX
+void
+fftx_init_stages (struct FFTAnalysis* ft, uint32_t n_stages)
+{
+	if (n_stages < 2 || ft->sub) {
+		return;
+	}
+
+	ft_decimator_init (&ft->dec, ft->n_channels);
+
+	const double fps = ft->sps_fps > 0 ? ft->rate / ft->sps_fps : 0;
+	ft->sub          = (struct FFTAnalysis*)malloc (sizeof (struct FFTAnalysis));
+	fftx_init (ft->sub, ft->window_size, ft->n_channels, ft->rate / 2, fps);
+	fftx_set_window (ft->sub, ft->window_type);
+	fftx_init_stages (ft->sub, n_stages - 1);
+}
+
+FFTX_FN_PREFIX
+uint32_t
+fftx_stages (struct FFTAnalysis* ft)
+{
+	return ft->sub ? 1 + fftx_stages (ft->sub) : 1;
+}
+
+/** analysis of the given stage, 0: full rate */
+FFTX_FN_PREFIX
+struct FFTAnalysis*
+fftx_stage (struct FFTAnalysis* ft, uint32_t s)
+{
+	while (s-- > 0 && ft->sub) {
+		ft = ft->sub;
+	}
+	return ft;
+}
+
+/** bins [lo, hi) of stage s that are displayed, stitched together
+ * they cover the complete spectrum without overlap:
+ * stage 0 down to rate/8, every further stage one octave below that,
+ * the last stage down to DC.
+ */
+FFTX_FN_PREFIX
+void
+fftx_stage_range (struct FFTAnalysis* ft, uint32_t s, uint32_t* lo, uint32_t* hi)
+{
+	const uint32_t n_stages = fftx_stages (ft);
+	const uint32_t d_siz    = ft->data_size;
+	*lo = s + 1 < n_stages ? d_siz / 4 : 1;
+	*hi = s == 0 ? d_siz - 1 : d_siz / 2;
+}
+
+/** set analysis overlap: an FFT is performed every (window_size / overlap)
+ * samples. 0: analyze at the frame-rate given to fftx_init()
+ */
+FFTX_FN_PREFIX
+void
+fftx_set_overlap (struct FFTAnalysis* ft, uint32_t overlap)
+{
+	if (ft->overlap == overlap) {
+		return;
+	}
+	ft->overlap = overlap;
+	ft->sps     = overlap > 0 ? MAX (1, ft->window_size / overlap) : ft->sps_fps;
+	ft->smps    = 0;
+	if (ft->sub) {
+		fftx_set_overlap (ft->sub, overlap);
+	}
+}
+
+/** average power spectra over n analysis frames */
+FFTX_FN_PREFIX
+void
+fftx_set_averaging (struct FFTAnalysis* ft, avg_t mode, uint32_t n)
+{
+	if (n < 2 || mode == AVG_NONE) {
+		mode = AVG_NONE;
+		n    = 1;
+	}
+	if (ft->avg_mode == mode && ft->avg_n == n) {
+		return;
+	}
+	ft->avg_mode = mode;
+	ft->avg_n    = n;
+	ft->avg_cnt  = 0;
+	memset (ft->power_sum, 0, ft->data_size * ft->n_traces * sizeof (float));
+	if (ft->sub) {
+		fftx_set_averaging (ft->sub, mode, n);
+	}
+}
+
+/** enable peak-hold, peaks are held for hold seconds (INFINITY: forever),
+ * then fall back with decay dB/sec (INFINITY: immediately) */
+FFTX_FN_PREFIX
+void
+fftx_set_peak (struct FFTAnalysis* ft, bool enable, float hold, float decay)
+{
+	if (ft->peak_on == enable && ft->peak_hold == hold && ft->peak_decay == decay) {
+		return;
+	}
+	ft->peak_on    = enable;
+	ft->peak_hold  = MAX (0.f, hold);
+	ft->peak_decay = MAX (0.f, decay);
+	memset (ft->peak, 0, ft->data_size * ft->n_traces * sizeof (float));
+	memset (ft->peak_age, 0, ft->data_size * ft->n_traces * sizeof (float));
+	if (ft->sub) {
+		fftx_set_peak (ft->sub, enable, hold, decay);
+	}
+}
+
+/** collect the time spent per analysis, of all stages. NULL: off */
+FFTX_FN_PREFIX
+void
+fftx_set_stats (struct FFTAnalysis* ft, SpectraHist* t_analyze)
+{
+	ft->t_analyze = t_analyze;
+	if (ft->sub) {
+		fftx_set_stats (ft->sub, t_analyze);
+	}
 }
 
 FFTX_FN_PREFIX
@@ -255,52 +980,61 @@ fftx_free (struct FFTAnalysis* ft)
 	if (!ft) {
 		return;
 	}
+	fftx_free (ft->sub);
 	pthread_mutex_lock (&fftw_planner_lock);
-	fftwf_destroy_plan (ft->fftplan);
-	if (instance_count > 0) {
-		--instance_count;
-	}
-#ifdef WITH_STATIC_FFTW_CLEANUP
-	/* use this only when statically linking to a local fftw!
-	 *
-	 * "After calling fftw_cleanup, all existing plans become undefined,
-	 *  and you should not attempt to execute them nor to destroy them."
-	 * [http://www.fftw.org/fftw3_doc/Using-Plans.html]
-	 *
-	 * If libfftwf is shared with other plugins or the host this can
-	 * cause undefined behavior.
-	 */
-	if (instance_count == 0) {
-		fftwf_cleanup ();
-	}
-#endif
+	ft_plan_release ();
 	pthread_mutex_unlock (&fftw_planner_lock);
-	free (ft->window);
+	fftx_window_release (ft->window);
 	free (ft->ringbuf);
 	fftwf_free (ft->fft_in);
 	fftwf_free (ft->fft_out);
+	fftwf_free (ft->fft_out_h);
 	free (ft->power);
-	free (ft->phase);
-	free (ft->phase_h);
+	free (ft->power_frame);
+	free (ft->power_sum);
+	free (ft->peak);
+	free (ft->peak_age);
+	ft_decimator_free (&ft->dec);
 	free (ft);
 }
 
+/** dst[i] = src[i] * window[i] */
+static void
+ft_apply_window (float* dst, float const* src, float const* window, const uint32_t n)
+{
+	uint32_t i = 0;
+#ifdef __SSE__
+	for (; i + 4 <= n; i += 4) {
+		_mm_storeu_ps (&dst[i], _mm_mul_ps (_mm_loadu_ps (&src[i]), _mm_loadu_ps (&window[i])));
+	}
+#endif
+	for (; i < n; ++i) {
+		dst[i] = src[i] * window[i];
+	}
+}
+
 static int
 _fftx_run (struct FFTAnalysis* ft,
-           const uint32_t n_samples, float const* const data)
+           const uint32_t n_samples, float const* const* data)
 {
 	assert (n_samples <= ft->window_size);
 
-	float* const f_buf = ft->fft_in;
-	float* const r_buf = ft->ringbuf;
-
 	const uint32_t n_off = ft->rboff;
 	const uint32_t n_siz = ft->window_size;
-	const uint32_t n_old = n_siz - n_samples;
+	const uint32_t n_p1  = MIN (n_samples, n_siz - n_off);
+	const uint32_t n_p2  = n_samples - n_p1;
 
-	for (uint32_t i = 0; i < n_samples; ++i) {
-		r_buf[(i + n_off) % n_siz] = data[i];
-		f_buf[n_old + i]           = data[i];
+	/* every sample is stored at [i] and [i + n_siz], so that
+	 * the most recent window_size samples are always contiguous */
+	for (uint32_t c = 0; c < ft->n_channels; ++c) {
+		float* const       r_buf = &ft->ringbuf[2 * c * n_siz];
+		float const* const d     = data[c];
+		memcpy (&r_buf[n_off], d, sizeof (float) * n_p1);
+		memcpy (&r_buf[n_off + n_siz], d, sizeof (float) * n_p1);
+		if (n_p2 > 0) {
+			memcpy (&r_buf[0], &d[n_p1], sizeof (float) * n_p2);
+			memcpy (&r_buf[n_siz], &d[n_p1], sizeof (float) * n_p2);
+		}
 	}
 
 	ft->rboff = (ft->rboff + n_samples) % n_siz;
@@ -315,44 +1049,47 @@ _fftx_run (struct FFTAnalysis* ft,
 	ft->step = n_samples;
 #endif
 
-	/* copy samples from ringbuffer into fft-buffer */
-	const uint32_t p0s = (n_off + n_samples) % n_siz;
-	if (p0s + n_old >= n_siz) {
-		const uint32_t n_p1 = n_siz - p0s;
-		const uint32_t n_p2 = n_old - n_p1;
-		memcpy (f_buf, &r_buf[p0s], sizeof (float) * n_p1);
-		memcpy (&f_buf[n_p1], &r_buf[0], sizeof (float) * n_p2);
-	} else {
-		memcpy (&f_buf[0], &r_buf[p0s], sizeof (float) * n_old);
-	}
+	float const* const window = ft->window->data;
 
-	/* apply window function */
-	float const* const window = ft_gen_window (ft);
-	for (uint32_t i = 0; i < ft->window_size; i++) {
-		ft->fft_in[i] *= window[i];
+	/* copy samples from ringbuffer into fft-buffer,
+	 * and apply shared window function */
+	for (uint32_t c = 0; c < ft->n_channels; ++c) {
+		ft_apply_window (&ft->fft_in[c * n_siz], &ft->ringbuf[2 * c * n_siz + ft->rboff], window, n_siz);
 	}
 
 	/* ..and analyze */
-	ft_analyze (ft);
+	const uint64_t t0      = ft->t_analyze ? spr_time_ns () : 0;
+	const bool     updated = ft_analyze (ft);
+	if (ft->t_analyze) {
+		spr_hist_time (ft->t_analyze, t0);
+	}
 
 	ft->phasediff_bin = ft->phasediff_step * (double)ft->step;
-	return 0;
+	return updated ? 0 : -1;
 }
 
-FFTX_FN_PREFIX
-int
-fftx_run (struct FFTAnalysis* ft,
-          const uint32_t n_samples, float const* const data)
+static int
+ft_run (struct FFTAnalysis* ft,
+        const uint32_t n_samples, float const* const* data)
 {
-	if (n_samples <= ft->window_size) {
+	if (n_samples <= ft->window_size && ft->smps + n_samples <= ft->sps) {
 		return _fftx_run (ft, n_samples, data);
 	}
 
+	float const* d[ft->n_channels];
+
 	int      rv = -1;
 	uint32_t n  = 0;
 	while (n < n_samples) {
+		/* split at hop boundaries, to analyze every sps samples */
 		uint32_t step = MIN (ft->window_size, n_samples - n);
-		if (!_fftx_run (ft, step, &data[n])) {
+		if (ft->sps > ft->smps) {
+			step = MIN (step, ft->sps - ft->smps);
+		}
+		for (uint32_t c = 0; c < ft->n_channels; ++c) {
+			d[c] = &data[c][n];
+		}
+		if (!_fftx_run (ft, step, d)) {
 			rv = 0;
 		}
 		n += step;
@@ -360,6 +1097,35 @@ fftx_run (struct FFTAnalysis* ft,
 	return rv;
 }
 
+/** process n_samples of every channel, data[channel][sample] */
+FFTX_FN_PREFIX
+int
+fftx_run (struct FFTAnalysis* ft,
+          const uint32_t n_samples, float const* const* data)
+{
+	int rv = ft_run (ft, n_samples, data);
+	if (!ft->sub) {
+		return rv;
+	}
+
+	float const* s[ft->n_channels];
+	float const* d[ft->n_channels];
+	for (uint32_t c = 0; c < ft->n_channels; ++c) {
+		d[c] = &ft->dec.out[c * FT_DEC_BLOCK / 2];
+	}
+	for (uint32_t n = 0; n < n_samples; n += FT_DEC_BLOCK) {
+		const uint32_t ns = MIN (FT_DEC_BLOCK, n_samples - n);
+		for (uint32_t c = 0; c < ft->n_channels; ++c) {
+			s[c] = &data[c][n];
+		}
+		const uint32_t n_out = ft_decimate (&ft->dec, s, ns);
+		if (n_out > 0 && !fftx_run (ft->sub, n_out, d)) {
+			rv = 0;
+		}
+	}
+	return rv;
+}
+
 FFTX_FN_PREFIX
 void
 fa_analyze_dsp (struct FFTAnalysis* ft,
@@ -397,6 +1163,29 @@ fftx_bins (struct FFTAnalysis* ft)
 	return ft->data_size;
 }
 
+FFTX_FN_PREFIX
+uint32_t
+fftx_traces (struct FFTAnalysis* ft)
+{
+	return ft->n_traces;
+}
+
+/** power spectrum of given trace (channel, or mid/side) */
+FFTX_FN_PREFIX
+float const*
+fftx_power (struct FFTAnalysis* ft, const uint32_t t)
+{
+	return &ft->power[t * ft->data_size];
+}
+
+/** peak-hold power of given trace, NULL if disabled, see fftx_set_peak() */
+FFTX_FN_PREFIX
+float const*
+fftx_peak (struct FFTAnalysis* ft, const uint32_t t)
+{
+	return ft->peak_on ? &ft->peak[t * ft->data_size] : NULL;
+}
+
 FFTX_FN_PREFIX
 inline float
 fast_log2 (float val)
@@ -438,24 +1227,427 @@ fftx_power_to_dB (float a)
 	return a > 1e-12 ? 10.0 * fast_log10 (a) : -INFINITY;
 }
 
+/* ***************************************************************************
+ * log-scale x-axis mapping
+ */
+
+struct FFTLogscale {
+	float log_rate;
+	float log_base;
+	float data_size;
+	float rate;
+};
+
+static void
+fl_init (struct FFTLogscale* fl, uint32_t window_size, double rate)
+{
+	fl->data_size = window_size / 2;
+	fl->log_rate  = (1.0f - 10000.0f / rate) / ((5000.0f / rate) * (5000.0f / rate));
+	fl->log_base  = log10f (1.0f + fl->log_rate);
+	fl->rate      = rate;
+}
+
+static float
+ft_x_deflect_bin (struct FFTLogscale* fl, float b)
+{
+	assert (fl->data_size > 0);
+	return fast_log10 (1.0 + b * fl->log_rate / (float)fl->data_size) / fl->log_base;
+}
+
 FFTX_FN_PREFIX
 float
-fftx_power_at_bin (struct FFTAnalysis* ft, const int b)
+fftx_power_at_bin (struct FFTAnalysis* ft, const uint32_t t, const int b)
 {
-	return (fftx_power_to_dB (ft->power[b]));
+	return (fftx_power_to_dB (ft->power[t * ft->data_size + b]));
 }
 
 FFTX_FN_PREFIX
 float
-fftx_freq_at_bin (struct FFTAnalysis* ft, const int b)
+fftx_freq_at_bin (struct FFTAnalysis* ft, const uint32_t t, const int b)
 {
-	/* calc phase: difference minus expected difference */
-	float phase = ft->phase[b] - ft->phase_h[b] - (float)b * ft->phasediff_bin;
+	float re, im, re_h, im_h;
+	ft_bin (ft, ft->fft_out, t, b, &re, &im);
+	ft_bin (ft, ft->fft_out_h, t, b, &re_h, &im_h);
+	/* calc phase: difference arg (X * conj (X_h)) minus expected difference */
+	float phase = atan2f (im * re_h - re * im_h, re * re_h + im * im_h) - (float)b * ft->phasediff_bin;
 	/* clamp to -M_PI .. M_PI */
 	int over = phase / M_PI;
 	over += (over >= 0) ? (over & 1) : -(over & 1);
 	phase -= M_PI * (float)over;
 	/* scale according to overlap */
-	phase *= (ft->data_size / ft->step) / M_PI;
+	phase *= ft->data_size / ((float)ft->step * M_PI);
 	return ft->freq_per_bin * ((float)b + phase);
 }
+
+/* ***************************************************************************
+ * fractional-octave smoothing
+ *
+ * Every bin is replaced by the mean power of all bins within +/- 1/2
+ * of a 1/n octave band around it. Band edges are pre-computed, and the
+ * mean is the difference of two prefix sums, so the cost is linear in
+ * the number of bins, regardless of the bandwidth.
+ */
+
+struct FFTSmooth {
+	uint32_t  max_bins;
+	uint32_t  n_bins;
+	uint32_t  fraction; /* 1/n octave, 0: off */
+	uint32_t* lo;       /* first bin of the band */
+	uint32_t* hi;       /* last bin of the band + 1 */
+	double*   csum;     /* prefix sum, max_bins + 1 */
+	float*    out;
+};
+
+static void
+fs_init (struct FFTSmooth* fs, uint32_t max_bins)
+{
+	fs->max_bins = max_bins;
+	fs->n_bins   = 0;
+	fs->fraction = 0;
+	fs->lo       = (uint32_t*)malloc (max_bins * sizeof (uint32_t));
+	fs->hi       = (uint32_t*)malloc (max_bins * sizeof (uint32_t));
+	fs->csum     = (double*)malloc ((max_bins + 1) * sizeof (double));
+	fs->out      = (float*)malloc (max_bins * sizeof (float));
+}
+
+static void
+fs_free (struct FFTSmooth* fs)
+{
+	free (fs->lo);
+	free (fs->hi);
+	free (fs->csum);
+	free (fs->out);
+}
+
+/** update band edges for 1/fraction octave smoothing of n_bins */
+static void
+fs_set (struct FFTSmooth* fs, uint32_t n_bins, uint32_t fraction)
+{
+	n_bins = MIN (n_bins, fs->max_bins);
+	if (fs->n_bins == n_bins && fs->fraction == fraction) {
+		return;
+	}
+	fs->n_bins   = n_bins;
+	fs->fraction = fraction;
+	if (fraction == 0) {
+		return;
+	}
+	/* bin frequencies are proportional to the bin index,
+	 * so are the band edges, independent of the sample-rate */
+	const double f = pow (2.0, .5 / fraction);
+	for (uint32_t i = 0; i < n_bins; ++i) {
+		fs->lo[i] = MIN (i, (uint32_t)lrint (i / f));
+		fs->hi[i] = MIN (n_bins, MAX (i + 1, (uint32_t)lrint (i * f) + 1));
+	}
+}
+
+/** smooth n_bins of power, see fs_set(). returns the smoothed data,
+ * or power itself if smoothing is off. */
+static float const*
+fs_run (struct FFTSmooth* fs, float const* power)
+{
+	if (fs->fraction == 0 || fs->n_bins == 0) {
+		return power;
+	}
+	double* const csum = fs->csum;
+	csum[0]            = 0;
+	for (uint32_t i = 0; i < fs->n_bins; ++i) {
+		csum[i + 1] = csum[i] + power[i];
+	}
+	for (uint32_t i = 0; i < fs->n_bins; ++i) {
+		fs->out[i] = (csum[fs->hi[i]] - csum[fs->lo[i]]) / (fs->hi[i] - fs->lo[i]);
+	}
+	return fs->out;
+}
+
+/* ***************************************************************************
+ * zoom FFT
+ *
+ * The input is mixed down to the center frequency of the band of interest,
+ * decimated by 2^n_stages and analyzed with a complex FFT. This gives
+ * window_size * 2^n_stages / 2 bins worth of resolution around the center,
+ * for the cost of a small transform.
+ */
+
+#define FZ_MAX_STAGES (8)
+
+struct FFTZoom {
+	uint32_t          window_size;
+	window_t          window_type;
+	struct FFTWindow* window;
+	uint32_t          n_channels;
+	uint32_t          n_traces;
+	double            rate;     /* input sample-rate */
+	double            center;   /* center frequency [Hz] */
+	uint32_t          n_stages; /* decimation by 2^n_stages */
+	double            fps;
+
+	/* local oscillator, rotated every sample */
+	double lo_re, lo_im;
+	double rot_re, rot_im;
+
+	struct FFTDecimator dec[FZ_MAX_STAGES];
+	float*              mix; /* I, Q of every channel */
+
+	float*         ringbuf; /* mirrored, 2 * window_size complex per channel */
+	uint32_t       rboff;
+	uint32_t       smps;
+	uint32_t       sps;
+	fftwf_complex* fft_in;
+	fftwf_complex* fft_out;
+	float*         power; /* window_size per trace, ascending frequency */
+	fftwf_plan     fftplan; /* shared, see ft_plan() */
+};
+
+FFTX_FN_PREFIX
+void
+fftz_reset (struct FFTZoom* fz)
+{
+	const uint32_t n_siz = fz->window_size;
+	for (uint32_t s = 0; s < FZ_MAX_STAGES; ++s) {
+		ft_decimator_reset (&fz->dec[s]);
+	}
+	memset (fz->ringbuf, 0, 4 * n_siz * fz->n_channels * sizeof (float));
+	memset (fz->power, 0, n_siz * fz->n_traces * sizeof (float));
+	fz->lo_re = 1;
+	fz->lo_im = 0;
+	fz->rboff = 0;
+	fz->smps  = 0;
+}
+
+/** set sample-rate, center frequency and zoom factor (2^n_stages).
+ * This does not allocate memory, the analysis is reset if anything changed.
+ */
+FFTX_FN_PREFIX
+void
+fftz_set (struct FFTZoom* fz, double rate, uint32_t n_stages, double center)
+{
+	n_stages = MIN (n_stages, FZ_MAX_STAGES);
+	if (fz->rate == rate && fz->n_stages == n_stages && fz->center == center) {
+		return;
+	}
+	fz->rate     = rate;
+	fz->n_stages = n_stages;
+	fz->center   = center;
+	fz->rot_re   = cos (-2. * M_PI * center / rate);
+	fz->rot_im   = sin (-2. * M_PI * center / rate);
+	fz->sps      = MAX (1, ceil (rate / (1 << n_stages) / fz->fps));
+	fftz_reset (fz);
+}
+
+FFTX_FN_PREFIX
+void
+fftz_init (struct FFTZoom* fz, uint32_t window_size, uint32_t n_channels, double rate, double fps)
+{
+	fz->window_size = window_size;
+	fz->window_type = W_HANN;
+	fz->window      = fftx_window_acquire (W_HANN, window_size);
+	fz->n_channels  = n_channels;
+	fz->n_traces    = n_channels == 2 ? 4 : n_channels;
+	fz->fps         = fps > 0 ? fps : 25;
+
+	for (uint32_t s = 0; s < FZ_MAX_STAGES; ++s) {
+		ft_decimator_init (&fz->dec[s], 2 * n_channels);
+	}
+	fz->mix     = (float*)malloc (2 * FT_DEC_BLOCK * n_channels * sizeof (float));
+	fz->ringbuf = (float*)malloc (4 * window_size * n_channels * sizeof (float));
+	fz->fft_in  = (fftwf_complex*)fftwf_malloc (sizeof (fftwf_complex) * window_size * n_channels);
+	fz->fft_out = (fftwf_complex*)fftwf_malloc (sizeof (fftwf_complex) * window_size * n_channels);
+	fz->power   = (float*)malloc (window_size * fz->n_traces * sizeof (float));
+
+	fz->rate     = 0;
+	fz->n_stages = 0;
+	fz->center   = 0;
+	fftz_set (fz, rate, 6, 1000);
+
+	pthread_mutex_lock (&fftw_planner_lock);
+	fz->fftplan = ft_plan (window_size, n_channels, true);
+	++instance_count;
+	pthread_mutex_unlock (&fftw_planner_lock);
+}
+
+FFTX_FN_PREFIX
+void
+fftz_free (struct FFTZoom* fz)
+{
+	if (!fz) {
+		return;
+	}
+	pthread_mutex_lock (&fftw_planner_lock);
+	ft_plan_release ();
+	pthread_mutex_unlock (&fftw_planner_lock);
+	for (uint32_t s = 0; s < FZ_MAX_STAGES; ++s) {
+		ft_decimator_free (&fz->dec[s]);
+	}
+	fftx_window_release (fz->window);
+	free (fz->mix);
+	free (fz->ringbuf);
+	fftwf_free (fz->fft_in);
+	fftwf_free (fz->fft_out);
+	free (fz->power);
+	free (fz);
+}
+
+FFTX_FN_PREFIX
+void
+fftz_set_window (struct FFTZoom* fz, window_t type)
+{
+	if (fz->window_type == type) {
+		return;
+	}
+	struct FFTWindow* w = fftx_window_acquire (type, fz->window_size);
+	if (!w) {
+		return;
+	}
+	fftx_window_release (fz->window);
+	fz->window      = w;
+	fz->window_type = type;
+}
+
+static void
+fz_analyze (struct FFTZoom* fz)
+{
+	const uint32_t     n_siz  = fz->window_size;
+	float const* const window = fz->window->data;
+
+	for (uint32_t c = 0; c < fz->n_channels; ++c) {
+		float const* r_buf = &fz->ringbuf[4 * c * n_siz + 2 * fz->rboff];
+		float*       in    = (float*)&fz->fft_in[c * n_siz];
+		for (uint32_t i = 0; i < n_siz; ++i) {
+			in[2 * i]     = r_buf[2 * i] * window[i];
+			in[2 * i + 1] = r_buf[2 * i + 1] * window[i];
+		}
+	}
+
+	fftwf_execute_dft (fz->fftplan, fz->fft_in, fz->fft_out);
+
+	/* reorder: negative frequencies first */
+	for (uint32_t c = 0; c < fz->n_channels; ++c) {
+		float const* out   = (float const*)&fz->fft_out[c * n_siz];
+		float*       power = &fz->power[c * n_siz];
+		for (uint32_t j = 0; j < n_siz; ++j) {
+			const uint32_t k = (j + n_siz / 2) % n_siz;
+			power[j]         = out[2 * k] * out[2 * k] + out[2 * k + 1] * out[2 * k + 1];
+		}
+	}
+
+	if (fz->n_traces > fz->n_channels) {
+		/* mid: (L + R) / 2, side: (L - R) / 2 */
+		float const* lft = (float const*)fz->fft_out;
+		float const* rgt = (float const*)&fz->fft_out[n_siz];
+		float*       p_m = &fz->power[2 * n_siz];
+		float*       p_s = &fz->power[3 * n_siz];
+		for (uint32_t j = 0; j < n_siz; ++j) {
+			const uint32_t k    = (j + n_siz / 2) % n_siz;
+			const float    m_re = lft[2 * k] + rgt[2 * k];
+			const float    m_im = lft[2 * k + 1] + rgt[2 * k + 1];
+			const float    s_re = lft[2 * k] - rgt[2 * k];
+			const float    s_im = lft[2 * k + 1] - rgt[2 * k + 1];
+			p_m[j]              = .25f * (m_re * m_re + m_im * m_im);
+			p_s[j]              = .25f * (s_re * s_re + s_im * s_im);
+		}
+	}
+}
+
+/** process n_samples of every channel, data[channel][sample] */
+FFTX_FN_PREFIX
+int
+fftz_run (struct FFTZoom* fz, const uint32_t n_samples, float const* const* data)
+{
+	const uint32_t n_chn = 2 * fz->n_channels;
+	const uint32_t n_siz = fz->window_size;
+	float const*   d[n_chn];
+	int            rv = -1;
+
+	for (uint32_t n = 0; n < n_samples; n += FT_DEC_BLOCK) {
+		const uint32_t ns = MIN (FT_DEC_BLOCK, n_samples - n);
+
+		/* mix down: I, Q = x * exp (-j w t) */
+		double lo_re = fz->lo_re;
+		double lo_im = fz->lo_im;
+		for (uint32_t i = 0; i < ns; ++i) {
+			for (uint32_t c = 0; c < fz->n_channels; ++c) {
+				const float x                           = data[c][n + i];
+				fz->mix[(2 * c) * FT_DEC_BLOCK + i]     = x * lo_re;
+				fz->mix[(2 * c + 1) * FT_DEC_BLOCK + i] = x * lo_im;
+			}
+			const double re = lo_re * fz->rot_re - lo_im * fz->rot_im;
+			lo_im           = lo_re * fz->rot_im + lo_im * fz->rot_re;
+			lo_re           = re;
+		}
+		/* keep the oscillator's amplitude at unity */
+		const double mag = sqrt (lo_re * lo_re + lo_im * lo_im);
+		fz->lo_re        = lo_re / mag;
+		fz->lo_im        = lo_im / mag;
+
+		/* decimate */
+		uint32_t n_out = ns;
+		for (uint32_t c = 0; c < n_chn; ++c) {
+			d[c] = &fz->mix[c * FT_DEC_BLOCK];
+		}
+		for (uint32_t s = 0; s < fz->n_stages && n_out > 0; ++s) {
+			n_out = ft_decimate (&fz->dec[s], d, n_out);
+			for (uint32_t c = 0; c < n_chn; ++c) {
+				d[c] = &fz->dec[s].out[c * FT_DEC_BLOCK / 2];
+			}
+		}
+		if (n_out == 0) {
+			continue;
+		}
+
+		/* store complex samples in the mirrored ringbuffer */
+		for (uint32_t c = 0; c < fz->n_channels; ++c) {
+			float* r_buf = &fz->ringbuf[4 * c * n_siz];
+			for (uint32_t i = 0; i < n_out; ++i) {
+				const uint32_t k           = (fz->rboff + i) % n_siz;
+				r_buf[2 * k]               = d[2 * c][i];
+				r_buf[2 * k + 1]           = d[2 * c + 1][i];
+				r_buf[2 * (k + n_siz)]     = d[2 * c][i];
+				r_buf[2 * (k + n_siz) + 1] = d[2 * c + 1][i];
+			}
+		}
+		fz->rboff = (fz->rboff + n_out) % n_siz;
+
+		fz->smps += n_out;
+		if (fz->smps >= fz->sps) {
+			fz->smps = 0;
+			fz_analyze (fz);
+			rv = 0;
+		}
+	}
+	return rv;
+}
+
+/** sample-rate after decimation, the analyzed bandwidth */
+FFTX_FN_PREFIX
+double
+fftz_rate (struct FFTZoom* fz)
+{
+	return fz->rate / (1 << fz->n_stages);
+}
+
+/** power spectrum of given trace, ascending frequency, see fftz_freq() */
+FFTX_FN_PREFIX
+float const*
+fftz_power (struct FFTZoom* fz, const uint32_t t)
+{
+	return &fz->power[t * fz->window_size];
+}
+
+/** frequency of bin b of fftz_power() */
+FFTX_FN_PREFIX
+double
+fftz_freq (struct FFTZoom* fz, double b)
+{
+	return fz->center + (b - fz->window_size * .5) * fftz_rate (fz) / fz->window_size;
+}
+
+/** bins [lo, hi) of fftz_power() that are free of aliasing,
+ * half of the decimated bandwidth, see ft_decimate() */
+FFTX_FN_PREFIX
+void
+fftz_range (struct FFTZoom* fz, uint32_t* lo, uint32_t* hi)
+{
+	*lo = fz->window_size / 4;
+	*hi = 3 * fz->window_size / 4;
+}
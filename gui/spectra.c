@@ -19,15 +19,23 @@
 #define RTK_URI SPR_URI "#"
 #define RTK_GUI "ui"
 
+#include <inttypes.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "../src/bfp.h"
+#include "../src/ringbuf.h"
+#include "../src/stats.h"
 #include "../src/uris.h"
 
 #ifdef HAVE_LV2_1_18_6
+#include <lv2/data-access/data-access.h>
+#include <lv2/instance-access/instance-access.h>
 #include <lv2/ui/ui.h>
 #else
+#include <lv2/lv2plug.in/ns/ext/data-access/data-access.h>
+#include <lv2/lv2plug.in/ns/ext/instance-access/instance-access.h>
 #include <lv2/lv2plug.in/ns/extensions/ui/ui.h>
 #endif
 
@@ -40,6 +48,26 @@
 #define MAX(A, B) ((A) > (B) ? (A) : (B))
 #endif
 
+/* largest supported FFT size, any even size up to this is allowed */
+#define MAX_FFT_SIZE (131072)
+
+/* multi-resolution analysis, each stage decimates by two */
+#define MR_STAGES (4)
+
+/* display points per trace, there is at most one per pixel column
+ * and stage, independent of the FFT size */
+#define MAX_POINTS (MR_STAGES * 4096)
+
+/* zoom analysis, see fftz_init() */
+#define ZOOM_FFT_SIZE (4096)
+
+/* waterfall colour-map entries, min_dB .. max_dB */
+#define WF_LUT_SIZE (256)
+
+/* per channel sample-buffer between port_event() and the analysis thread */
+#define AN_RINGSIZE (65536)
+#define AN_BUFSIZE (8192)
+
 /* widget, window size */
 #define WWIDTH (ui->xyp->w_width)
 #define WHEIGHT (ui->xyp->w_height)
@@ -52,29 +80,6 @@
 #define DWIDTH (WWIDTH - AWIDTH)
 #define DHEIGHT (WHEIGHT - AHEIGHT)
 
-struct FFTLogscale {
-	float log_rate;
-	float log_base;
-	float data_size;
-	float rate;
-};
-
-static void
-fl_init (struct FFTLogscale* fl, uint32_t window_size, double rate)
-{
-	fl->data_size = window_size / 2;
-	fl->log_rate  = (1.0f - 10000.0f / rate) / ((5000.0f / rate) * (5000.0f / rate));
-	fl->log_base  = log10f (1.0f + fl->log_rate);
-	fl->rate      = rate;
-}
-
-static float
-ft_x_deflect_bin (struct FFTLogscale* fl, float b)
-{
-	assert (fl->data_size > 0);
-	return fast_log10 (1.0 + b * fl->log_rate / (float)fl->data_size) / fl->log_base;
-}
-
 typedef struct {
 	LV2_Atom_Forge forge;
 	LV2_URID_Map*  map;
@@ -83,6 +88,10 @@ typedef struct {
 	LV2UI_Write_Function write;
 	LV2UI_Controller     controller;
 
+	/* direct access to the DSP's raw audio, see SpectraRingInterface */
+	void*                       instance;
+	const SpectraRingInterface* ring;
+
 	RobWidget*       vbox;
 	RobTkXYp*        xyp;
 	cairo_surface_t* ann_power;
@@ -92,6 +101,16 @@ typedef struct {
 	RobTkSelect* sel_fft;
 	RobTkSelect* sel_window;
 	RobTkCBtn*   btn_color;
+	RobTkCBtn*   btn_dsp;
+	RobTkCBtn*   btn_multires;
+	RobTkCBtn*   btn_waterfall;
+	RobTkCBtn*   btn_stats;
+	RobTkSelect* sel_trace;
+	RobTkSelect* sel_overlap;
+	RobTkSelect* sel_avg;
+	RobTkSelect* sel_smooth;
+	RobTkSelect* sel_peak;
+	RobTkSelect* sel_zoom;
 	RobTkSep*    sep0;
 	RobTkSep*    sep1;
 
@@ -103,15 +122,170 @@ typedef struct {
 	uint32_t window_size;
 	bool     pink_scale;
 	window_t window_fun;
+	bool     dsp_fft;
+	bool     multires;
+	uint32_t zoom;        /* decimation stages, 0: off */
+	float    zoom_center; /* Hz */
+	uint32_t trace_mask;
+	uint32_t overlap;   /* see fftx_set_overlap() */
+	int32_t  averaging; /* see SPR_AVG() */
+	uint32_t smooth;    /* 1/n octave smoothing, 0: off */
+	uint32_t peak;      /* index of peak_modes[], 0: off */
+	bool     waterfall;
 
 	bool disable_signals;
 
 	struct FFTAnalysis* fa;
 	struct FFTLogscale  fl;
-	float*              p_x, *p_y;
+	struct FFTZoom*     fz;
+
+	/* the analysis is re-created in the background by fa_builder(),
+	 * and swapped in by the thread that uses it, see fa_swap() */
+	pthread_t           fa_thread;
+	pthread_mutex_t     fa_lock;
+	pthread_cond_t      fa_signal;
+	bool                fa_exit;
+	uint32_t            fa_size;     /* most recently requested size */
+	float               fa_rate;     /* most recently requested rate */
+	uint32_t            fa_stages;   /* most recently requested stages */
+	bool                fa_request;  /* build pending */
+	struct FFTAnalysis* fa_next;     /* ready to be swapped in */
+	struct FFTWindow*   window_ref;  /* keeps the selected window table cached */
+	struct FFTWindow*   zwindow_ref; /* same, at ZOOM_FFT_SIZE */
+
+	/* display points of every trace, the first visible trace
+	 * is drawn by robtk_xydraw, others by draw_traces() */
+	pthread_mutex_t trace_lock;
+	float*          p_x[MAX_TRACES];
+	float*          p_y[MAX_TRACES];
+	uint32_t        p_n[MAX_TRACES];
+
+	/* back-buffer written by the analysis thread,
+	 * swapped with p_x, p_y under the trace_lock */
+	float*   q_x[MAX_TRACES];
+	float*   q_y[MAX_TRACES];
+	uint32_t q_n[MAX_TRACES];
+
+	/* peak-hold display points, same as above, see draw_traces() */
+	float*   pk_x[MAX_TRACES];
+	float*   pk_y[MAX_TRACES];
+	uint32_t pk_n[MAX_TRACES];
+	float*   qk_x[MAX_TRACES];
+	float*   qk_y[MAX_TRACES];
+	uint32_t qk_n[MAX_TRACES];
+	bool     points_ready;
+	bool     scales_dirty;
+
+	/* the DSP suspended raw audio, see input_silent() */
+	bool silent;
+	bool an_flush;
+
+	/* the FFT is performed in a separate thread, see analysis_thread() */
+	pthread_t       an_thread;
+	pthread_mutex_t an_lock;
+	pthread_cond_t  an_signal;
+	bool            an_pending;
+	bool            an_exit;
+	SpectraRing*    an_ring[MAX_CHANNELS];
+	float*          an_buf[MAX_CHANNELS];
+
+	/* used by the analysis thread only, see spectrum_points() */
+	struct FFTSmooth fs;
+
+	/* waterfall, a ring of pixel rows at display resolution.
+	 * The GUI thread (re)creates the surface, the analysis thread renders
+	 * a row and copies it in under the trace_lock, see waterfall_update() */
+	cairo_surface_t* wf_surf;
+	unsigned char*   wf_data; /* pixels of wf_surf */
+	int              wf_width;
+	int              wf_height;
+	int              wf_stride;
+	uint32_t         wf_row;  /* most recent row */
+	float*           wf_col;  /* max. power of every pixel column */
+	uint32_t*        wf_line; /* rendered row */
+	uint32_t         wf_size; /* allocated size of wf_col, wf_line */
+	uint32_t         wf_lut[WF_LUT_SIZE];
+
+	/* pixel column of every FFT bin, see update_column_map() */
+	uint32_t* col_lut;
+	uint32_t  col_width;
+	uint32_t  col_bins;
+	uint32_t  col_stages;
+	float     col_rate;
+
+	/* raw audio, collected until all channels of a cycle are received */
+	float*   chn_buf[MAX_CHANNELS];
+	uint32_t chn_n[MAX_CHANNELS];
+	uint32_t chn_buf_size;
+
+	/* raw audio stream position, see raw_position() */
+	int64_t  frame_pos; /* start of the current cycle */
+	int64_t  frame_next;
+	int64_t  ring_dropped; /* most recent count of the DSP, SPR_ENC_RING */
+	bool     frame_valid;
+	uint64_t dropped; /* total number of lost samples */
+
+	/* instrumentation, see draw_stats() and stats_json() */
+	bool        show_stats;
+	uint64_t    st_events;   /* port events received */
+	SpectraHist st_run;      /* fftx_run () [ns] */
+	SpectraHist st_analyze;  /* ft_analyze () [ns] */
+	SpectraHist st_points;   /* display points and waterfall [ns] */
+	SpectraHist st_forged;   /* bytes per cycle, reported by the DSP */
+	uint64_t    st_capacity; /* cycles skipped by the DSP */
 
 } SpectraUI;
 
+/** frequency range [Hz] of the zoomed display */
+static void
+zoom_range (SpectraUI* ui, float* f_lo, float* span)
+{
+	/* half of the decimated bandwidth, see fftz_range() */
+	*span = ui->rate / (1 << ui->zoom) * .5f;
+	*f_lo = ui->zoom_center - *span * .5f;
+}
+
+/** linear frequency axis of the zoom analysis */
+static void
+draw_zoom_scale (SpectraUI* ui, cairo_t* cr)
+{
+	char  buf[32];
+	float f_lo, span;
+	zoom_range (ui, &f_lo, &span);
+
+	/* 1, 2, 5 steps, about 8-20 lines */
+	float step = powf (10.f, floorf (log10f (span / 8.f)));
+	if (span / step > 40) {
+		step *= 5;
+	} else if (span / step > 16) {
+		step *= 2;
+	}
+	const int prec = step < 1 ? (step < .1 ? 2 : 1) : 0;
+
+	for (float f = ceilf (f_lo / step) * step; f <= f_lo + span; f += step) {
+		const float x = (f - f_lo) / span * DWIDTH + AWIDTH;
+
+		if (f < 1000.0) {
+			sprintf (buf, "%0.*fHz", prec, f);
+		} else {
+			sprintf (buf, "%0.*fkHz", prec + 3 - (step >= 10) - (step >= 100), f / 1000.0);
+		}
+
+		cairo_set_source_rgb (cr, 0.6, 0.6, 0.6);
+		cairo_move_to (cr, x + 2.0, 3.0);
+
+		cairo_rotate (cr, M_PI / 2.0);
+		cairo_show_text (cr, buf);
+		cairo_rotate (cr, -M_PI / 2.0);
+		cairo_stroke (cr);
+
+		cairo_set_source_rgb (cr, 0.3, 0.3, 0.3);
+		cairo_move_to (cr, rintf (x) - .5, WHEIGHT);
+		cairo_line_to (cr, rintf (x) - .5, 0.0);
+		cairo_stroke (cr);
+	}
+}
+
 static void
 draw_scales (SpectraUI* ui)
 {
@@ -129,7 +303,12 @@ draw_scales (SpectraUI* ui)
 	cairo_rectangle (cr, 0.0, 0.0, WWIDTH, WHEIGHT);
 	cairo_fill (cr);
 
-	const float divisor = ui->rate / 2.0 / (float)fftx_bins (ui->fa);
+	/* x-axis mapping of the current analysis */
+	pthread_mutex_lock (&ui->trace_lock);
+	struct FFTLogscale fl = ui->fl;
+	pthread_mutex_unlock (&ui->trace_lock);
+
+	const float divisor = fl.rate / 2.0 / fl.data_size;
 
 	cairo_set_font_size (cr, 9);
 	cairo_text_extents_t t_ext;
@@ -167,13 +346,20 @@ draw_scales (SpectraUI* ui)
 	cairo_set_line_width (cr, 1.25);
 	cairo_set_dash (cr, NULL, 0, 0);
 
+	if (ui->zoom > 0) {
+		draw_zoom_scale (ui, cr);
+		cairo_destroy (cr);
+		robtk_xydraw_set_surface (ui->xyp, ui->ann_power);
+		return;
+	}
+
 	for (int32_t i = 0; i < 41; ++i) {
 		if (i < 7 && (i % 4))
 			continue;
 		if (i == 8)
 			continue;
 		const double f_m = pow (2, (i - 17) / 3.) * 1000.0;
-		x                = ft_x_deflect_bin (&ui->fl, f_m / divisor) * DWIDTH + AWIDTH;
+		x                = ft_x_deflect_bin (&fl, f_m / divisor) * DWIDTH + AWIDTH;
 
 		if (f_m >= ui->rate * .5) {
 			break;
@@ -203,33 +389,153 @@ draw_scales (SpectraUI* ui)
 	robtk_xydraw_set_surface (ui->xyp, ui->ann_power);
 }
 
+/** background thread, creates a new analysis for the requested size and rate */
+static void*
+fa_builder (void* arg)
+{
+	SpectraUI* ui = (SpectraUI*)arg;
+	pthread_mutex_lock (&ui->fa_lock);
+	while (!ui->fa_exit) {
+		if (!ui->fa_request) {
+			pthread_cond_wait (&ui->fa_signal, &ui->fa_lock);
+			continue;
+		}
+		const uint32_t fft_size = ui->fa_size;
+		const float    rate     = ui->fa_rate;
+		const uint32_t stages   = ui->fa_stages;
+		ui->fa_request          = false;
+		pthread_mutex_unlock (&ui->fa_lock);
+
+		struct FFTAnalysis* fa = (struct FFTAnalysis*)malloc (sizeof (struct FFTAnalysis));
+		fftx_init (fa, fft_size, ui->n_channels, rate, 60);
+		fftx_init_stages (fa, stages);
+		fftx_set_window (fa, ui->window_fun);
+
+		/* replace an earlier result that was not yet used */
+		fftx_free (__atomic_exchange_n (&ui->fa_next, fa, __ATOMIC_ACQ_REL));
+
+		pthread_mutex_lock (&ui->fa_lock);
+	}
+	pthread_mutex_unlock (&ui->fa_lock);
+	return NULL;
+}
+
+/** use a new analysis, if one is ready.
+ * called by the thread that runs the analysis, see analysis_thread()
+ */
+static void
+fa_swap (SpectraUI* ui)
+{
+	struct FFTAnalysis* fa = __atomic_exchange_n (&ui->fa_next, NULL, __ATOMIC_ACQ_REL);
+	if (!fa) {
+		return;
+	}
+	pthread_mutex_lock (&ui->trace_lock);
+	fftx_free (ui->fa);
+	ui->fa = fa;
+	fl_init (&ui->fl, fa->window_size, fa->rate);
+	for (uint32_t t = 0; t < MAX_TRACES; ++t) {
+		ui->p_n[t] = 0;
+	}
+	pthread_mutex_unlock (&ui->trace_lock);
+	__atomic_store_n (&ui->scales_dirty, true, __ATOMIC_RELEASE);
+}
+
+/** request an analysis for the current window-size, sample-rate and mode.
+ * The first one is created immediately, later ones in the background;
+ * until it's ready, the previous analysis remains in use.
+ */
 static void
 reinitialize_fft (SpectraUI* ui)
 {
-	uint32_t fft_size = MIN (16384, MAX (1024, ui->window_size));
-	fft_size--;
-	fft_size |= fft_size >> 1;
-	fft_size |= fft_size >> 2;
-	fft_size |= fft_size >> 4;
-	fft_size |= fft_size >> 8;
-	fft_size |= fft_size >> 16;
-	fft_size++;
-	fft_size = MIN (16384, fft_size);
-
-	if (ui->fa && ui->fa->window_size == fft_size) {
+	/* sizes need not be a power of two, e.g. 48000 for 1Hz bins at 48kHz.
+	 * the real-to-halfcomplex transform requires an even size */
+	const uint32_t fft_size = MIN (MAX_FFT_SIZE, MAX (1024, ui->window_size)) & ~1;
+
+	const uint32_t stages = ui->multires ? MR_STAGES : 1;
+
+	pthread_mutex_lock (&ui->fa_lock);
+	if (ui->fa_size == fft_size && ui->fa_rate == ui->rate && ui->fa_stages == stages) {
+		pthread_mutex_unlock (&ui->fa_lock);
 		return;
 	}
+	ui->fa_size   = fft_size;
+	ui->fa_rate   = ui->rate;
+	ui->fa_stages = stages;
+
+	if (!ui->fa) {
+		ui->fa = (struct FFTAnalysis*)malloc (sizeof (struct FFTAnalysis));
+		fftx_init (ui->fa, fft_size, ui->n_channels, ui->rate, 60);
+		fftx_init_stages (ui->fa, stages);
+		fl_init (&ui->fl, fft_size, ui->rate);
+	} else {
+		ui->fa_request = true;
+		pthread_cond_signal (&ui->fa_signal);
+	}
+	pthread_mutex_unlock (&ui->fa_lock);
+}
+
+/** return buffer for n_samples of the given channel */
+static float*
+chn_buffer (SpectraUI* ui, const uint32_t channel, const uint32_t n_samples)
+{
+	if (ui->chn_buf_size < n_samples) {
+		for (uint32_t c = 0; c < ui->n_channels; ++c) {
+			free (ui->chn_buf[c]);
+			ui->chn_buf[c] = (float*)malloc (n_samples * sizeof (float));
+			ui->chn_n[c]   = 0;
+			if (!ui->chn_buf[c]) {
+				ui->chn_buf_size = 0;
+				return NULL;
+			}
+		}
+		ui->chn_buf_size = n_samples;
+	}
+	return ui->chn_buf[channel];
+}
 
-	fftx_free (ui->fa);
-	free (ui->p_x);
-	free (ui->p_y);
-	ui->fa = (struct FFTAnalysis*)malloc (sizeof (struct FFTAnalysis));
-	fftx_init (ui->fa, fft_size, ui->rate, 60);
-	fl_init (&ui->fl, fft_size, ui->rate);
-	ui->p_x = (float*)malloc (fftx_bins (ui->fa) * sizeof (float));
-	ui->p_y = (float*)malloc (fftx_bins (ui->fa) * sizeof (float));
+/** first visible trace, drawn by robtk_xydraw */
+static uint32_t
+primary_trace (SpectraUI* ui)
+{
+	for (uint32_t t = 0; t < MAX_TRACES; ++t) {
+		if (ui->trace_mask & (1 << t)) {
+			return t;
+		}
+	}
+	return 0;
+}
+
+/** the waterfall replaces the spectrum of the GUI's own analysis */
+static bool
+show_waterfall (SpectraUI* ui)
+{
+	return ui->waterfall && !ui->dsp_fft && ui->zoom == 0;
 }
 
+static const float trace_color[MAX_TRACES][4] = {
+	{ .3, .9, .3, 1.0 },
+	{ .9, .3, .3, 1.0 },
+	{ .9, .8, .2, 1.0 },
+	{ .3, .6, 1., 1.0 },
+};
+
+/* peak-hold modes, the index is sent to the DSP */
+static const struct {
+	const char* name;
+	float       hold;  /* sec */
+	float       decay; /* dB/sec */
+} peak_modes[] = {
+	{ "No Peak", 0, 0 },
+	{ "Peak Hold", INFINITY, 0 },
+	{ "Hold 2s", 2, INFINITY },
+	{ "Fall 10dB/s", 0, 10 },
+	{ "Fall 30dB/s", 0, 30 },
+	{ "Hold 1s, Fall", 1, 20 },
+};
+
+#define N_PEAK_MODES (sizeof (peak_modes) / sizeof (peak_modes[0]))
+
 /******************************************************************************
  * Communication with DSP backend -- send/receive settings
  */
@@ -260,10 +566,49 @@ ui_enable (LV2UI_Handle handle)
 	LV2_Atom_Forge_Frame frame;
 	lv2_atom_forge_frame_time (&ui->forge, 0);
 	LV2_Atom* msg = (LV2_Atom*)x_forge_object (&ui->forge, &frame, 1, ui->uris.ui_on);
+	lv2_atom_forge_property_head (&ui->forge, ui->uris.encoding, 0);
+	lv2_atom_forge_int (&ui->forge, ui->ring ? SPR_ENC_RING : SPR_ENC_BFP);
 	lv2_atom_forge_pop (&ui->forge, &frame);
 	ui->write (ui->controller, 0, lv2_atom_total_size (msg), ui->uris.atom_eventTransfer, msg);
 }
 
+/** send a setting to the backend, which retains it while the UI is closed */
+static void
+ui_send_setting (SpectraUI* ui, LV2_URID key, int32_t val)
+{
+	uint8_t obj_buf[64];
+	lv2_atom_forge_set_buffer (&ui->forge, obj_buf, 64);
+	LV2_Atom_Forge_Frame frame;
+	lv2_atom_forge_frame_time (&ui->forge, 0);
+	LV2_Atom* msg = (LV2_Atom*)x_forge_object (&ui->forge, &frame, 1, ui->uris.ui_state);
+	lv2_atom_forge_property_head (&ui->forge, key, 0);
+	lv2_atom_forge_int (&ui->forge, val);
+	lv2_atom_forge_pop (&ui->forge, &frame);
+	ui->write (ui->controller, 0, lv2_atom_total_size (msg), ui->uris.atom_eventTransfer, msg);
+}
+
+static void
+ui_send_setting_float (SpectraUI* ui, LV2_URID key, float val)
+{
+	uint8_t obj_buf[64];
+	lv2_atom_forge_set_buffer (&ui->forge, obj_buf, 64);
+	LV2_Atom_Forge_Frame frame;
+	lv2_atom_forge_frame_time (&ui->forge, 0);
+	LV2_Atom* msg = (LV2_Atom*)x_forge_object (&ui->forge, &frame, 1, ui->uris.ui_state);
+	lv2_atom_forge_property_head (&ui->forge, key, 0);
+	lv2_atom_forge_float (&ui->forge, val);
+	lv2_atom_forge_pop (&ui->forge, &frame);
+	ui->write (ui->controller, 0, lv2_atom_total_size (msg), ui->uris.atom_eventTransfer, msg);
+}
+
+/** request DSP-side analysis with one point per pixel, or raw audio */
+static void
+ui_set_dspfft (SpectraUI* ui)
+{
+	const int32_t n_points = ui->dsp_fft ? MIN (MAX_DSP_POINTS, MAX (64, DWIDTH)) : 0;
+	ui_send_setting (ui, ui->uris.dspfft, n_points);
+}
+
 /******************************************************************************
  * WIDGET CALLBACKS
  */
@@ -277,8 +622,8 @@ cb_set_fft (RobWidget* handle, void* data)
 		return TRUE;
 	}
 	ui->window_size = fft_size;
+	/* scales are updated once the new analysis is in use */
 	reinitialize_fft (ui);
-	draw_scales (ui);
 	if (ui->disable_signals)
 		return TRUE;
 	ui->write (ui->controller, SPR_FFTSIZE, sizeof (float), 0, (const void*)&fft_size);
@@ -298,6 +643,170 @@ cb_set_color (RobWidget* handle, void* data)
 	return TRUE;
 }
 
+static bool
+cb_set_dsp (RobWidget* handle, void* data)
+{
+	SpectraUI* ui = (SpectraUI*)data;
+	ui->dsp_fft   = robtk_cbtn_get_active (ui->btn_dsp);
+	/* zoom, smoothing, peak-hold and waterfall need raw audio */
+	robtk_select_set_sensitive (ui->sel_zoom, !ui->dsp_fft);
+	robtk_select_set_sensitive (ui->sel_smooth, !ui->dsp_fft);
+	robtk_select_set_sensitive (ui->sel_peak, !ui->dsp_fft);
+	robtk_cbtn_set_sensitive (ui->btn_waterfall, !ui->dsp_fft);
+	if (ui->disable_signals) {
+		return TRUE;
+	}
+	ui_set_dspfft (ui);
+	return TRUE;
+}
+
+/** keep the zoomed band within 0 .. rate/2 */
+static void
+set_zoom_center (SpectraUI* ui, float freq)
+{
+	const float span = ui->rate / (1 << MAX (1, ui->zoom)) * .5f;
+	ui->zoom_center  = MAX (span * .5f, MIN (ui->rate * .5f - span * .5f, freq));
+}
+
+static bool
+cb_set_zoom (RobWidget* handle, void* data)
+{
+	SpectraUI*     ui   = (SpectraUI*)data;
+	const uint32_t zoom = robtk_select_get_value (ui->sel_zoom);
+	if (ui->zoom == zoom) {
+		return TRUE;
+	}
+	ui->zoom = zoom;
+	set_zoom_center (ui, ui->zoom_center);
+	__atomic_store_n (&ui->scales_dirty, true, __ATOMIC_RELEASE);
+	if (ui->disable_signals) {
+		return TRUE;
+	}
+	ui_send_setting (ui, ui->uris.zoom, zoom);
+	ui_send_setting_float (ui, ui->uris.zoomfreq, ui->zoom_center);
+	return TRUE;
+}
+
+static bool
+cb_set_multires (RobWidget* handle, void* data)
+{
+	SpectraUI* ui = (SpectraUI*)data;
+	ui->multires  = robtk_cbtn_get_active (ui->btn_multires);
+	reinitialize_fft (ui);
+	if (ui->disable_signals) {
+		return TRUE;
+	}
+	ui_send_setting (ui, ui->uris.multires, ui->multires ? 1 : 0);
+	return TRUE;
+}
+
+static bool
+cb_set_waterfall (RobWidget* handle, void* data)
+{
+	SpectraUI* ui = (SpectraUI*)data;
+	ui->waterfall = robtk_cbtn_get_active (ui->btn_waterfall);
+	/* hide or show the primary trace */
+	__atomic_store_n (&ui->points_ready, true, __ATOMIC_RELEASE);
+	if (ui->disable_signals) {
+		return TRUE;
+	}
+	ui_send_setting (ui, ui->uris.waterfall, ui->waterfall ? 1 : 0);
+	return TRUE;
+}
+
+static bool
+cb_set_stats (RobWidget* handle, void* data)
+{
+	SpectraUI* ui  = (SpectraUI*)data;
+	ui->show_stats = robtk_cbtn_get_active (ui->btn_stats);
+	queue_draw (ui->xyp->rw);
+	return TRUE;
+}
+
+static bool
+cb_set_trace (RobWidget* handle, void* data)
+{
+	SpectraUI*     ui   = (SpectraUI*)data;
+	const uint32_t mask = robtk_select_get_value (ui->sel_trace);
+	if (ui->trace_mask == mask) {
+		return TRUE;
+	}
+	pthread_mutex_lock (&ui->trace_lock);
+	ui->trace_mask = mask;
+	pthread_mutex_unlock (&ui->trace_lock);
+	const uint32_t t = primary_trace (ui);
+	robtk_xydraw_set_color (ui->xyp, trace_color[t][0], trace_color[t][1], trace_color[t][2], trace_color[t][3]);
+	if (ui->disable_signals) {
+		return TRUE;
+	}
+	ui_send_setting (ui, ui->uris.traces, mask);
+	return TRUE;
+}
+
+static bool
+cb_set_overlap (RobWidget* handle, void* data)
+{
+	SpectraUI*     ui      = (SpectraUI*)data;
+	const uint32_t overlap = robtk_select_get_value (ui->sel_overlap);
+	if (ui->overlap == overlap) {
+		return TRUE;
+	}
+	ui->overlap = overlap;
+	if (ui->disable_signals) {
+		return TRUE;
+	}
+	ui_send_setting (ui, ui->uris.overlap, overlap);
+	return TRUE;
+}
+
+static bool
+cb_set_avg (RobWidget* handle, void* data)
+{
+	SpectraUI*    ui  = (SpectraUI*)data;
+	const int32_t avg = robtk_select_get_value (ui->sel_avg);
+	if (ui->averaging == avg) {
+		return TRUE;
+	}
+	ui->averaging = avg;
+	if (ui->disable_signals) {
+		return TRUE;
+	}
+	ui_send_setting (ui, ui->uris.averaging, avg);
+	return TRUE;
+}
+
+static bool
+cb_set_smooth (RobWidget* handle, void* data)
+{
+	SpectraUI*     ui     = (SpectraUI*)data;
+	const uint32_t smooth = robtk_select_get_value (ui->sel_smooth);
+	if (ui->smooth == smooth) {
+		return TRUE;
+	}
+	ui->smooth = smooth;
+	if (ui->disable_signals) {
+		return TRUE;
+	}
+	ui_send_setting (ui, ui->uris.smoothing, smooth);
+	return TRUE;
+}
+
+static bool
+cb_set_peak (RobWidget* handle, void* data)
+{
+	SpectraUI*     ui   = (SpectraUI*)data;
+	const uint32_t peak = robtk_select_get_value (ui->sel_peak);
+	if (ui->peak == peak) {
+		return TRUE;
+	}
+	ui->peak = peak;
+	if (ui->disable_signals) {
+		return TRUE;
+	}
+	ui_send_setting (ui, ui->uris.peak, peak);
+	return TRUE;
+}
+
 static bool
 cb_set_window (RobWidget* handle, void* data)
 {
@@ -307,6 +816,16 @@ cb_set_window (RobWidget* handle, void* data)
 	if (ui->window_fun == wf) {
 		return TRUE;
 	}
+
+	/* prepare the window table, before the analysis uses it */
+	pthread_mutex_lock (&ui->fa_lock);
+	const uint32_t fft_size = ui->fa_size;
+	pthread_mutex_unlock (&ui->fa_lock);
+	fftx_window_release (ui->window_ref);
+	ui->window_ref = fftx_window_acquire (wf, fft_size);
+	fftx_window_release (ui->zwindow_ref);
+	ui->zwindow_ref = fftx_window_acquire (wf, ZOOM_FFT_SIZE);
+
 	ui->window_fun = wf;
 	if (ui->disable_signals) {
 		return TRUE;
@@ -318,14 +837,410 @@ cb_set_window (RobWidget* handle, void* data)
 
 /******************************************************************************/
 
+/** map FFT bins of every stage to pixel columns of the data area,
+ * only updated when the window is resized or the analysis changes */
+static void
+update_column_map (SpectraUI* ui)
+{
+	const uint32_t width  = MAX (1, DWIDTH);
+	const uint32_t bins   = fftx_bins (ui->fa);
+	const uint32_t stages = fftx_stages (ui->fa);
+	if (ui->col_width == width && ui->col_bins == bins && ui->col_stages == stages && ui->col_rate == ui->fl.rate) {
+		return;
+	}
+	for (uint32_t s = 0; s < stages; ++s) {
+		/* the x-axis is scaled in bins of the first stage */
+		const float scale = 1.f / (1 << s);
+		for (uint32_t i = 0; i < bins; ++i) {
+			ui->col_lut[s * bins + i] = floorf (ft_x_deflect_bin (&ui->fl, i * scale) * width);
+		}
+	}
+	ui->col_width  = width;
+	ui->col_bins   = bins;
+	ui->col_stages = stages;
+	ui->col_rate   = ui->fl.rate;
+}
+
+/** compute display points of trace t from the current analysis.
+ *
+ * Bins that have a pixel column to themselves (low frequencies) are
+ * placed at their phase-corrected frequency. Bins that share a column
+ * are reduced to a single point with the max. power of the column.
+ *
+ * A multi-resolution analysis is stitched together from the
+ * frequency range of every stage, see fftx_stage_range().
+ *
+ * With fractional-octave smoothing, the smoothed power is mapped
+ * the same way, see fs_run(). With peak, the peak-hold power is used
+ * instead, at the bin's nominal position.
+ *
+ * If wf_col is given, the max. power of every pixel column is collected
+ * there as well, for the waterfall.
+ */
+static uint32_t
+spectrum_points (SpectraUI* ui, const uint32_t t, const bool peak, float* p_x, float* p_y, float* wf_col)
+{
+	const float rwidth    = DWIDTH / WWIDTH;
+	const float rheight   = DHEIGHT / WHEIGHT;
+	const float aoffs_x   = AWIDTH / WWIDTH;
+	const float min_coeff = powf (10.f, .1f * ui->min_dB);
+	const float hscale    = rheight / (ui->max_dB - ui->min_dB);
+	const bool  pink      = ui->pink_scale;
+
+	const uint32_t b = fftx_bins (ui->fa);
+	uint32_t       p = 0;
+
+	/* lowest frequencies first, those are in the last stage */
+	for (uint32_t s = fftx_stages (ui->fa); s-- > 0;) {
+		struct FFTAnalysis* fa     = fftx_stage (ui->fa, s);
+		float const*        power  = fs_run (&ui->fs, peak ? fftx_peak (fa, t) : fftx_power (fa, t));
+		uint32_t const*     col    = &ui->col_lut[s * b];
+		const float         pscale = .5f / (1 << s);
+
+		uint32_t lo, hi;
+		fftx_stage_range (ui->fa, s, &lo, &hi);
+
+		for (uint32_t i = lo; i < hi && p < MAX_POINTS;) {
+			float    ffpow = pink ? (power[i] * i * pscale) : power[i];
+			uint32_t k     = i + 1;
+			for (; k < hi && col[k] == col[i]; ++k) {
+				const float pk = pink ? (power[k] * k * pscale) : power[k];
+				if (pk > ffpow) {
+					ffpow = pk;
+				}
+			}
+			if (wf_col) {
+				const uint32_t c = MIN (col[i], ui->col_width - 1);
+				if (ffpow > wf_col[c]) {
+					wf_col[c] = ffpow;
+				}
+			}
+			if (ffpow >= min_coeff) {
+				if (k == i + 1 && !peak) {
+					p_x[p] = ft_x_deflect_bin (&ui->fl, fftx_freq_at_bin (fa, t, i) / ui->fa->freq_per_bin) * rwidth + aoffs_x;
+				} else {
+					p_x[p] = (col[i] + .5f) / WWIDTH + aoffs_x;
+				}
+				p_y[p] = (fftx_power_to_dB (ffpow) - ui->min_dB) * hscale;
+				p++;
+			}
+			i = k;
+		}
+	}
+	return p;
+}
+
+/** dB to colour map of the waterfall, min_dB .. max_dB */
+static void
+waterfall_lut (SpectraUI* ui)
+{
+	static const float stops[][4] = {
+		{ 0.0, 0.0, 0.0, 0.0 },
+		{ .30, 0.0, 0.0, 0.7 },
+		{ .55, 0.8, 0.0, 0.4 },
+		{ .80, 1.0, 0.7, 0.0 },
+		{ 1.0, 1.0, 1.0, 1.0 },
+	};
+	uint32_t k = 0;
+	for (uint32_t i = 0; i < WF_LUT_SIZE; ++i) {
+		const float v = i / (WF_LUT_SIZE - 1.f);
+		while (k < 3 && v > stops[k + 1][0]) {
+			++k;
+		}
+		const float f = (v - stops[k][0]) / (stops[k + 1][0] - stops[k][0]);
+		uint32_t    px = 0;
+		for (int c = 1; c < 4; ++c) {
+			const float cv = stops[k][c] + f * (stops[k + 1][c] - stops[k][c]);
+			px             = (px << 8) | (uint32_t)rintf (255.f * cv);
+		}
+		ui->wf_lut[i] = px;
+	}
+}
+
+/** prepare the column buffer of the waterfall for spectrum_points(),
+ * returns NULL if the waterfall is not shown (analysis thread) */
+static float*
+waterfall_columns (SpectraUI* ui)
+{
+	const uint32_t width = ui->col_width;
+	if (ui->wf_size < width) {
+		free (ui->wf_col);
+		free (ui->wf_line);
+		ui->wf_col  = (float*)malloc (width * sizeof (float));
+		ui->wf_line = (uint32_t*)malloc (width * sizeof (uint32_t));
+		ui->wf_size = (ui->wf_col && ui->wf_line) ? width : 0;
+	}
+	if (ui->wf_size == 0) {
+		return NULL;
+	}
+	memset (ui->wf_col, 0, width * sizeof (float));
+	return ui->wf_col;
+}
+
+/** add a row to the waterfall, from the columns collected by spectrum_points().
+ *
+ * Only the newest row is rendered, outside of the lock, the cost is
+ * independent of the waterfall's height (analysis thread).
+ */
+static void
+waterfall_update (SpectraUI* ui)
+{
+	const int   width  = ui->col_width;
+	const float lscale = (WF_LUT_SIZE - 1) / (ui->max_dB - ui->min_dB);
+
+	float const* col = ui->wf_col;
+	uint32_t*    px  = ui->wf_line;
+	float        pw  = 0;
+	for (int c = 0; c < width; ++c) {
+		/* columns without a bin of their own (low frequencies)
+		 * repeat the previous one */
+		if (col[c] > 0) {
+			pw = col[c];
+		}
+		const float l = (fftx_power_to_dB (pw) - ui->min_dB) * lscale;
+		px[c]         = ui->wf_lut[l <= 0 ? 0 : l >= WF_LUT_SIZE - 1 ? WF_LUT_SIZE - 1 : (int)l];
+	}
+
+	/* newest row on top, scroll down. Skip rows while resizing */
+	pthread_mutex_lock (&ui->trace_lock);
+	if (ui->wf_data && ui->wf_width == width) {
+		ui->wf_row = (ui->wf_row + ui->wf_height - 1) % ui->wf_height;
+		memcpy (ui->wf_data + ui->wf_row * ui->wf_stride, px, width * sizeof (uint32_t));
+	}
+	pthread_mutex_unlock (&ui->trace_lock);
+}
+
+/** compute display points of trace t from the zoom analysis,
+ * on a linear x-axis. Bins that share a pixel column are reduced
+ * to a single point with the max. power of the column.
+ */
+static uint32_t
+zoom_points (SpectraUI* ui, const uint32_t t, float* p_x, float* p_y)
+{
+	const float    rwidth    = DWIDTH / WWIDTH;
+	const float    rheight   = DHEIGHT / WHEIGHT;
+	const float    aoffs_x   = AWIDTH / WWIDTH;
+	const float    min_coeff = powf (10.f, .1f * ui->min_dB);
+	const float    hscale    = rheight / (ui->max_dB - ui->min_dB);
+	const bool     pink      = ui->pink_scale;
+	const uint32_t width     = MAX (1, DWIDTH);
+
+	struct FFTZoom* fz    = ui->fz;
+	float const*    power = fftz_power (fz, t);
+
+	/* pink: weight with the bin-number of a regular analysis */
+	const float fpb = ui->fl.rate * .5f / ui->fl.data_size;
+
+	uint32_t lo, hi;
+	fftz_range (fz, &lo, &hi);
+	const uint32_t n_bins = hi - lo;
+	const float    xscale = rwidth / n_bins;
+
+	uint32_t p = 0;
+	for (uint32_t i = lo; i < hi && p < MAX_POINTS;) {
+		const uint32_t col   = (i - lo) * width / n_bins;
+		float          ffpow = 0;
+		uint32_t       k     = i;
+		for (; k < hi && (k - lo) * width / n_bins == col; ++k) {
+			const float pk = pink ? (power[k] * .5f * fftz_freq (fz, k) / fpb) : power[k];
+			if (pk > ffpow) {
+				ffpow = pk;
+			}
+		}
+		if (ffpow >= min_coeff) {
+			p_x[p] = ((i + k - 1) * .5f - lo) * xscale + aoffs_x;
+			p_y[p] = (fftx_power_to_dB (ffpow) - ui->min_dB) * hscale;
+			p++;
+		}
+		i = k;
+	}
+	return p;
+}
+
+/** analyze all queued audio, and publish display points (analysis thread) */
+static void
+analyze_spectrum (SpectraUI* ui)
+{
+	float const*   d[MAX_CHANNELS];
+	bool           analyzed = false;
+	const uint32_t zoom     = ui->zoom;
+
+	fa_swap (ui);
+	fftx_set_stats (ui->fa, &ui->st_analyze);
+	fftx_set_window (ui->fa, ui->window_fun);
+	fftx_set_overlap (ui->fa, ui->overlap);
+	fftx_set_averaging (ui->fa, SPR_AVG_MODE (ui->averaging), SPR_AVG_N (ui->averaging));
+	const uint32_t peak = ui->peak < N_PEAK_MODES ? ui->peak : 0;
+	fftx_set_peak (ui->fa, peak > 0, peak_modes[peak].hold, peak_modes[peak].decay);
+	if (zoom > 0) {
+		fftz_set (ui->fz, ui->rate, zoom, ui->zoom_center);
+		fftz_set_window (ui->fz, ui->window_fun);
+	}
+
+	uint32_t n_avail = spr_ring_read_space (ui->an_ring[0]);
+	for (uint32_t c = 1; c < ui->n_channels; ++c) {
+		n_avail = MIN (n_avail, spr_ring_read_space (ui->an_ring[c]));
+	}
+
+	while (n_avail > 0) {
+		const uint32_t n = MIN (n_avail, AN_BUFSIZE);
+		for (uint32_t c = 0; c < ui->n_channels; ++c) {
+			spr_ring_read (ui->an_ring[c], ui->an_buf[c], n);
+			d[c] = ui->an_buf[c];
+		}
+		const uint64_t t0 = spr_time_ns ();
+		if (zoom > 0 ? !fftz_run (ui->fz, n, d) : !fftx_run (ui->fa, n, d)) {
+			analyzed = true;
+		}
+		spr_hist_time (&ui->st_run, t0);
+		n_avail -= n;
+	}
+
+	if (__atomic_exchange_n (&ui->an_flush, false, __ATOMIC_ACQ_REL)) {
+		/* start over when the signal returns */
+		fftx_reset (ui->fa);
+		fftz_reset (ui->fz);
+		pthread_mutex_lock (&ui->trace_lock);
+		for (uint32_t t = 0; t < MAX_TRACES; ++t) {
+			ui->p_n[t]  = 0;
+			ui->pk_n[t] = 0;
+		}
+		pthread_mutex_unlock (&ui->trace_lock);
+		return;
+	}
+
+	if (!analyzed) {
+		return;
+	}
+
+	const uint64_t t0 = spr_time_ns ();
+	update_column_map (ui);
+	fs_set (&ui->fs, fftx_bins (ui->fa), ui->smooth);
+	for (uint32_t t = 0; t < fftx_traces (ui->fa); ++t) {
+		if (!(ui->trace_mask & (1 << t))) {
+			ui->q_n[t] = 0;
+		} else if (zoom > 0) {
+			ui->q_n[t] = zoom_points (ui, t, ui->q_x[t], ui->q_y[t]);
+		} else if (show_waterfall (ui) && t == primary_trace (ui)) {
+			float* wf_col = waterfall_columns (ui);
+			ui->q_n[t]    = spectrum_points (ui, t, false, ui->q_x[t], ui->q_y[t], wf_col);
+			if (wf_col) {
+				waterfall_update (ui);
+			}
+		} else {
+			ui->q_n[t] = spectrum_points (ui, t, false, ui->q_x[t], ui->q_y[t], NULL);
+		}
+		if (peak > 0 && zoom == 0 && (ui->trace_mask & (1 << t))) {
+			ui->qk_n[t] = spectrum_points (ui, t, true, ui->qk_x[t], ui->qk_y[t], NULL);
+		} else {
+			ui->qk_n[t] = 0;
+		}
+	}
+	spr_hist_time (&ui->st_points, t0);
+
+	/* flip buffers */
+	pthread_mutex_lock (&ui->trace_lock);
+	for (uint32_t t = 0; t < fftx_traces (ui->fa); ++t) {
+		float*         x = ui->p_x[t];
+		float*         y = ui->p_y[t];
+		const uint32_t n = ui->p_n[t];
+		ui->p_x[t]       = ui->q_x[t];
+		ui->p_y[t]       = ui->q_y[t];
+		ui->p_n[t]       = ui->q_n[t];
+		ui->q_x[t]       = x;
+		ui->q_y[t]       = y;
+		ui->q_n[t]       = n;
+
+		x           = ui->pk_x[t];
+		y           = ui->pk_y[t];
+		ui->pk_x[t] = ui->qk_x[t];
+		ui->pk_y[t] = ui->qk_y[t];
+		ui->pk_n[t] = ui->qk_n[t];
+		ui->qk_x[t] = x;
+		ui->qk_y[t] = y;
+	}
+	pthread_mutex_unlock (&ui->trace_lock);
+	__atomic_store_n (&ui->points_ready, true, __ATOMIC_RELEASE);
+}
+
+static void*
+analysis_thread (void* arg)
+{
+	SpectraUI* ui = (SpectraUI*)arg;
+	pthread_mutex_lock (&ui->an_lock);
+	while (!ui->an_exit) {
+		if (!ui->an_pending) {
+			pthread_cond_wait (&ui->an_signal, &ui->an_lock);
+			continue;
+		}
+		ui->an_pending = false;
+		pthread_mutex_unlock (&ui->an_lock);
+		analyze_spectrum (ui);
+		pthread_mutex_lock (&ui->an_lock);
+	}
+	pthread_mutex_unlock (&ui->an_lock);
+	return NULL;
+}
+
+static void
+analysis_wakeup (SpectraUI* ui)
+{
+	pthread_mutex_lock (&ui->an_lock);
+	ui->an_pending = true;
+	pthread_cond_signal (&ui->an_signal);
+	pthread_mutex_unlock (&ui->an_lock);
+}
+
+/** redraw the scales if needed (communication thread) */
+static void
+update_scales (SpectraUI* ui)
+{
+	if (__atomic_exchange_n (&ui->scales_dirty, false, __ATOMIC_ACQ_REL)
+	    || cairo_image_surface_get_width (ui->ann_power) != WWIDTH
+	    || cairo_image_surface_get_height (ui->ann_power) != WHEIGHT) {
+		draw_scales (ui);
+	}
+}
+
+/** raw audio was lost, e.g. the host's buffer overflowed (communication thread).
+ *
+ * Rather than splicing non-contiguous audio, which smears the spectrum,
+ * the gap is filled with silence, up to one FFT window.
+ */
+static void
+raw_gap (SpectraUI* ui, const int64_t n_lost)
+{
+	uint32_t n = MIN (n_lost, ui->window_size);
+	for (uint32_t c = 0; c < ui->n_channels; ++c) {
+		n = MIN (n, spr_ring_write_space (ui->an_ring[c]));
+	}
+	for (uint32_t c = 0; c < ui->n_channels; ++c) {
+		spr_ring_write_zero (ui->an_ring[c], n);
+	}
+	__atomic_add_fetch (&ui->dropped, n_lost, __ATOMIC_RELAXED);
+}
+
+/** some channels of the most recent cycle are missing (communication thread).
+ * The cycle is dropped and counted as a gap, unless it is the first one */
+static void
+incomplete_cycle (SpectraUI* ui, const uint32_t n_elem)
+{
+	if (ui->frame_valid) {
+		raw_gap (ui, n_elem);
+	}
+	for (uint32_t c = 0; c < ui->n_channels; ++c) {
+		ui->chn_n[c] = 0;
+	}
+}
+
 /** this callback runs in the "communication" thread of the LV2-host
  * -- invoked via port_event(); please see notes there.
  *
  *  it acts as 'glue' between LV2 port_event() and GTK expose_event_callback()
  *
- *  This is a wrapper, around above 'update_scope_real()' it allows
- *  to update the UI state in sync with the 1st channel and
- *  upsamples the data if neccesary.
+ *  Audio of all but the last channel is buffered, all channels
+ *  are queued for analysis together once the last channel of a cycle arrives.
+ *  The most recent result of the analysis thread is passed on for display.
  */
 static void
 update_spectrum (SpectraUI* ui, const uint32_t channel, const size_t n_elem, float const* data)
@@ -333,55 +1248,353 @@ update_spectrum (SpectraUI* ui, const uint32_t channel, const size_t n_elem, flo
 	/* this callback runs in the "communication" thread of the LV2-host
    * usually a g_timeout() at ~25fps
    */
-	if (channel > ui->n_channels || channel != 0) {
+	if (channel >= ui->n_channels) {
 		return;
 	}
 
-	if (cairo_image_surface_get_width (ui->ann_power) != WWIDTH || cairo_image_surface_get_height (ui->ann_power) != WHEIGHT) {
-		draw_scales (ui);
+	__atomic_store_n (&ui->silent, false, __ATOMIC_RELEASE);
+
+	if (channel + 1 < ui->n_channels) {
+		float* buf = chn_buffer (ui, channel, n_elem);
+		if (buf && buf != data) {
+			memcpy (buf, data, n_elem * sizeof (float));
+		}
+		ui->chn_n[channel] = buf ? n_elem : 0;
+		return;
+	}
+
+	float const* d[MAX_CHANNELS];
+	for (uint32_t c = 0; c < channel; ++c) {
+		if (ui->chn_n[c] != n_elem) {
+			/* incomplete cycle, lost events */
+			incomplete_cycle (ui, n_elem);
+			return;
+		}
+		ui->chn_n[c] = 0;
+		d[c]         = ui->chn_buf[c];
+	}
+	d[channel] = data;
+
+	/* queue audio for the analysis thread, all channels in lockstep */
+	uint32_t n = n_elem;
+	for (uint32_t c = 0; c < ui->n_channels; ++c) {
+		n = MIN (n, spr_ring_write_space (ui->an_ring[c]));
+	}
+	for (uint32_t c = 0; c < ui->n_channels; ++c) {
+		spr_ring_write (ui->an_ring[c], d[c], n);
 	}
+	analysis_wakeup (ui);
+
+	update_scales (ui);
+
+	if (__atomic_exchange_n (&ui->points_ready, false, __ATOMIC_ACQ_REL)) {
+		const uint32_t primary = primary_trace (ui);
+		pthread_mutex_lock (&ui->trace_lock);
+		robtk_xydraw_set_points (ui->xyp, show_waterfall (ui) ? 0 : ui->p_n[primary], ui->p_x[primary], ui->p_y[primary]);
+		pthread_mutex_unlock (&ui->trace_lock);
+	}
+}
+
+/** check the stream position of raw audio (communication thread).
+ * All channels of a cycle share the same position, a new position
+ * starts the next cycle, regardless which channel arrives first.
+ */
+static void
+raw_position (SpectraUI* ui, const int64_t pos, const uint32_t n_elem)
+{
+	if (pos < 0 || (ui->frame_valid && pos == ui->frame_pos)) {
+		return;
+	}
+	for (uint32_t c = 0; c < ui->n_channels; ++c) {
+		if (ui->chn_n[c] > 0) {
+			/* later channels of the previous cycle were lost */
+			incomplete_cycle (ui, ui->frame_next - ui->frame_pos);
+			break;
+		}
+	}
+	if (ui->frame_valid && pos > ui->frame_next) {
+		raw_gap (ui, pos - ui->frame_next);
+	}
+	ui->frame_pos   = pos;
+	ui->frame_next  = pos + n_elem;
+	ui->frame_valid = true;
+}
+
+/** the DSP stopped sending raw audio, since the input is silent
+ * (communication thread). Blank the display until audio returns.
+ */
+static void
+input_silent (SpectraUI* ui)
+{
+	for (uint32_t c = 0; c < ui->n_channels; ++c) {
+		ui->chn_n[c] = 0;
+	}
+	__atomic_store_n (&ui->silent, true, __ATOMIC_RELEASE);
+	__atomic_store_n (&ui->an_flush, true, __ATOMIC_RELEASE);
+	analysis_wakeup (ui);
+
+	pthread_mutex_lock (&ui->trace_lock);
+	for (uint32_t t = 0; t < MAX_TRACES; ++t) {
+		ui->p_n[t]  = 0;
+		ui->pk_n[t] = 0;
+	}
+	robtk_xydraw_set_points (ui->xyp, 0, ui->p_x[0], ui->p_y[0]);
+	pthread_mutex_unlock (&ui->trace_lock);
+}
+
+/** this callback runs in the "communication" thread of the LV2-host
+ *
+ * display a power spectrum that was analyzed by the DSP backend,
+ * the points are equally spaced on the x-axis.
+ */
+static void
+update_bands (SpectraUI* ui, const uint32_t trace, const size_t n_elem, float const* data)
+{
+	if (trace >= MAX_TRACES) {
+		return;
+	}
+
+	/* the analysis thread swaps in a new FFT size, if any */
+	analysis_wakeup (ui);
+	update_scales (ui);
 
 	const float rwidth    = DWIDTH / WWIDTH;
 	const float rheight   = DHEIGHT / WHEIGHT;
 	const float aoffs_x   = AWIDTH / WWIDTH;
 	const float min_coeff = powf (10.f, .1f * ui->min_dB);
 	const float hscale    = rheight / (ui->max_dB - ui->min_dB);
-	const bool  pink      = ui->pink_scale;
+	const float xscale    = rwidth / (float)n_elem;
 
-	fftx_set_window (ui->fa, ui->window_fun);
+	pthread_mutex_lock (&ui->trace_lock);
+	float* const p_x = ui->p_x[trace];
+	float* const p_y = ui->p_y[trace];
 
-	if (!fftx_run (ui->fa, n_elem, data)) {
-		uint32_t p = 0;
-		uint32_t b = fftx_bins (ui->fa);
-		for (uint32_t i = 1; i < b - 1; i++) {
-#if 0
-      float ffpow = ui->fa->power[i];
-      if (pink) {
-	float norm = fftx_freq_at_bin(ui->fa, i) / ui->fa->freq_per_bin;
-	if (norm <= 1) { norm = 1; }
-	ffpow *= norm * .5;
-      }
-#else
-			const float ffpow = pink ? (ui->fa->power[i] * i * .5) : ui->fa->power[i];
-#endif
-			if (ffpow < min_coeff) {
-				continue;
-				ui->p_x[p] = ft_x_deflect_bin (&ui->fl, i) * rwidth + aoffs_x;
-				ui->p_y[p] = 0;
-			} else {
-				ui->p_x[p] = ft_x_deflect_bin (&ui->fl, fftx_freq_at_bin (ui->fa, i) / ui->fa->freq_per_bin) * rwidth + aoffs_x;
-				ui->p_y[p] = (fftx_power_to_dB (ffpow) - ui->min_dB) * hscale;
-			}
-			p++;
+	uint32_t p = 0;
+	for (uint32_t i = 0; i < n_elem && i < MAX_DSP_POINTS && (ui->trace_mask & (1 << trace)); ++i) {
+		if (data[i] < min_coeff) {
+			continue;
 		}
-		robtk_xydraw_set_points (ui->xyp, p, ui->p_x, ui->p_y);
+		p_x[p] = (i + .5f) * xscale + aoffs_x;
+		p_y[p] = (fftx_power_to_dB (data[i]) - ui->min_dB) * hscale;
+		p++;
 	}
+	ui->p_n[trace] = p;
+
+	if (trace == primary_trace (ui)) {
+		robtk_xydraw_set_points (ui->xyp, p, p_x, p_y);
+	}
+	pthread_mutex_unlock (&ui->trace_lock);
+}
+
+/** silence marker and number of lost samples, top right (GUI thread) */
+static void
+draw_status (SpectraUI* ui, cairo_t* cr)
+{
+	char                 buf[64];
+	cairo_text_extents_t ext;
+	const uint64_t       dropped = __atomic_load_n (&ui->dropped, __ATOMIC_RELAXED);
+	double               y       = AHEIGHT + 6.0;
+
+	cairo_save (cr);
+	cairo_set_source_rgb (cr, 0.6, 0.6, 0.6);
+	if (__atomic_load_n (&ui->silent, __ATOMIC_ACQUIRE)) {
+		cairo_set_font_size (cr, 12);
+		cairo_text_extents (cr, "Silence", &ext);
+		y += ext.height;
+		cairo_move_to (cr, WWIDTH - ext.width - 8.0, y);
+		cairo_show_text (cr, "Silence");
+		y += 6.0;
+	}
+	if (dropped > 0) {
+		snprintf (buf, sizeof (buf), "%" PRIu64 " samples lost", dropped);
+		cairo_set_font_size (cr, 9);
+		cairo_text_extents (cr, buf, &ext);
+		y += ext.height;
+		cairo_move_to (cr, WWIDTH - ext.width - 8.0, y);
+		cairo_show_text (cr, buf);
+	}
+	cairo_restore (cr);
+}
+
+/** print a summary of a histogram of durations */
+static void
+stats_line (cairo_t* cr, double y, const char* name, SpectraHist const* h)
+{
+	char buf[128];
+	snprintf (buf, sizeof (buf), "%-11s n: %-8" PRIu64 " mean: %7.1fus  p99: <%7.1fus  max: %7.1fus",
+	          name, h->n, spr_hist_mean (h) * 1e-3,
+	          spr_hist_percentile (h, .99) * 1e-3, h->max * 1e-3);
+	cairo_move_to (cr, AWIDTH + 8.0, y);
+	cairo_show_text (cr, buf);
+}
+
+/** instrumentation overlay, top left (GUI thread) */
+static void
+draw_stats (SpectraUI* ui, cairo_t* cr)
+{
+	char buf[128];
+	cairo_save (cr);
+	cairo_select_font_face (cr, "monospace", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+	cairo_set_font_size (cr, 9);
+	cairo_rectangle (cr, AWIDTH + 4.0, AHEIGHT + 4.0, 420, 66);
+	cairo_set_source_rgba (cr, 0, 0, 0, .7);
+	cairo_fill (cr);
+	cairo_set_source_rgb (cr, 0.8, 0.8, 0.8);
+
+	double y = AHEIGHT + 16.0;
+	stats_line (cr, y, "fftx_run", &ui->st_run);
+	y += 12.0;
+	stats_line (cr, y, "ft_analyze", &ui->st_analyze);
+	y += 12.0;
+	stats_line (cr, y, "points", &ui->st_points);
+	y += 12.0;
+
+	snprintf (buf, sizeof (buf), "%-11s mean: %.0f bytes  max: %" PRIu64 " bytes", "DSP cycle",
+	          spr_hist_mean (&ui->st_forged), ui->st_forged.max);
+	cairo_move_to (cr, AWIDTH + 8.0, y);
+	cairo_show_text (cr, buf);
+	y += 12.0;
+
+	snprintf (buf, sizeof (buf), "%-11s %" PRIu64 " received, %" PRIu64 " cycles skipped (buffer size)",
+	          "events", ui->st_events, ui->st_capacity);
+	cairo_move_to (cr, AWIDTH + 8.0, y);
+	cairo_show_text (cr, buf);
+	cairo_restore (cr);
+}
+
+/** dump all statistics as JSON, one line (GUI thread) */
+static void
+stats_json (SpectraUI* ui, FILE* f)
+{
+	fprintf (f, "{\"events\": %" PRIu64 ", \"lost_samples\": %" PRIu64 ", \"dsp\": {\"capacity_skipped\": %" PRIu64 ", \"forged_bytes\": ",
+	         ui->st_events, __atomic_load_n (&ui->dropped, __ATOMIC_RELAXED), ui->st_capacity);
+	spr_hist_json (f, &ui->st_forged);
+	fprintf (f, "}, \"ui\": {\"fftx_run_ns\": ");
+	spr_hist_json (f, &ui->st_run);
+	fprintf (f, ", \"ft_analyze_ns\": ");
+	spr_hist_json (f, &ui->st_analyze);
+	fprintf (f, ", \"points_ns\": ");
+	spr_hist_json (f, &ui->st_points);
+	fprintf (f, "}}\n");
+	fflush (f);
+}
+
+/** draw the waterfall ring, newest row at the top (GUI thread).
+ * The ring is (re)started when the plot is resized. */
+static void
+draw_waterfall (SpectraUI* ui, cairo_t* cr)
+{
+	const int w = MAX (1, DWIDTH);
+	const int h = MAX (1, DHEIGHT);
+	if (pthread_mutex_trylock (&ui->trace_lock)) {
+		return;
+	}
+	if (!ui->wf_surf || ui->wf_width != w || ui->wf_height != h) {
+		if (ui->wf_surf) {
+			cairo_surface_destroy (ui->wf_surf);
+		}
+		ui->wf_surf = cairo_image_surface_create (CAIRO_FORMAT_RGB24, w, h);
+		ui->wf_data = NULL;
+		ui->wf_row  = 0;
+		if (cairo_surface_status (ui->wf_surf) != CAIRO_STATUS_SUCCESS) {
+			pthread_mutex_unlock (&ui->trace_lock);
+			return;
+		}
+		cairo_surface_flush (ui->wf_surf);
+		ui->wf_data   = cairo_image_surface_get_data (ui->wf_surf);
+		ui->wf_width  = w;
+		ui->wf_height = h;
+		ui->wf_stride = cairo_image_surface_get_stride (ui->wf_surf);
+		memset (ui->wf_data, 0, h * ui->wf_stride);
+	}
+	/* rows were written directly by waterfall_update () */
+	cairo_surface_mark_dirty (ui->wf_surf);
+	cairo_save (cr);
+	cairo_rectangle (cr, AWIDTH, AHEIGHT, w, h);
+	cairo_clip (cr);
+	/* rows [wf_row, h) followed by [0, wf_row) */
+	cairo_set_source_surface (cr, ui->wf_surf, AWIDTH, AHEIGHT - (int)ui->wf_row);
+	cairo_paint (cr);
+	cairo_set_source_surface (cr, ui->wf_surf, AWIDTH, AHEIGHT + h - (int)ui->wf_row);
+	cairo_paint (cr);
+	cairo_restore (cr);
+	pthread_mutex_unlock (&ui->trace_lock);
+}
+
+/** draw all but the primary trace, and peak-hold of all traces (GUI thread) */
+static void
+draw_traces (SpectraUI* ui, cairo_t* cr)
+{
+	const uint32_t primary = primary_trace (ui);
+
+	/* the lock is held while passing points to the xy-plot, which
+	 * is locked during expose: skip, another redraw is pending */
+	if (pthread_mutex_trylock (&ui->trace_lock)) {
+		return;
+	}
+	cairo_save (cr);
+	cairo_set_line_width (cr, 1.5);
+	for (uint32_t t = 0; t < MAX_TRACES; ++t) {
+		if (t == primary || 0 == ui->p_n[t] || !(ui->trace_mask & (1 << t))) {
+			continue;
+		}
+		float const* const p_x = ui->p_x[t];
+		float const* const p_y = ui->p_y[t];
+		for (uint32_t i = 0; i < ui->p_n[t]; ++i) {
+			const float x = rintf (p_x[i] * WWIDTH) - .5;
+			cairo_move_to (cr, x, WHEIGHT);
+			cairo_line_to (cr, x, WHEIGHT * (1.f - p_y[i]));
+		}
+		cairo_set_source_rgba (cr, trace_color[t][0], trace_color[t][1], trace_color[t][2], .75 * trace_color[t][3]);
+		cairo_stroke (cr);
+	}
+	cairo_set_line_width (cr, 1.0);
+	for (uint32_t t = 0; t < MAX_TRACES && !ui->dsp_fft; ++t) {
+		if (0 == ui->pk_n[t] || !(ui->trace_mask & (1 << t))) {
+			continue;
+		}
+		float const* const p_x = ui->pk_x[t];
+		float const* const p_y = ui->pk_y[t];
+		cairo_move_to (cr, p_x[0] * WWIDTH, WHEIGHT * (1.f - p_y[0]));
+		for (uint32_t i = 1; i < ui->pk_n[t]; ++i) {
+			cairo_line_to (cr, p_x[i] * WWIDTH, WHEIGHT * (1.f - p_y[i]));
+		}
+		/* lighter than the trace itself */
+		cairo_set_source_rgba (cr, .5 + .5 * trace_color[t][0], .5 + .5 * trace_color[t][1], .5 + .5 * trace_color[t][2], trace_color[t][3]);
+		cairo_stroke (cr);
+	}
+	cairo_restore (cr);
+	pthread_mutex_unlock (&ui->trace_lock);
 }
 
 /******************************************************************************
  * RobWidget
  */
 
+/** click on the zoomed plot: re-center the zoom band at the given frequency,
+ * zoom itself is only enabled with the selector */
+static RobWidget*
+xydraw_mousedown (RobWidget* handle, RobTkBtnEvent* ev)
+{
+	SpectraUI*  ui = (SpectraUI*)((RobTkXYp*)GET_HANDLE (handle))->handle;
+	const float x  = (ev->x - AWIDTH) / DWIDTH;
+	if (ev->button == 3 && ui->show_stats) {
+		/* right-click on the overlay */
+		stats_json (ui, stdout);
+		return handle;
+	}
+	if (ev->button != 1 || x < 0 || x > 1 || ui->dsp_fft || ui->zoom == 0) {
+		return NULL;
+	}
+
+	float f_lo, span;
+	zoom_range (ui, &f_lo, &span);
+	set_zoom_center (ui, f_lo + x * span);
+	__atomic_store_n (&ui->scales_dirty, true, __ATOMIC_RELEASE);
+	ui_send_setting_float (ui, ui->uris.zoomfreq, ui->zoom_center);
+	return handle;
+}
+
 static void
 xydraw_size_request (RobWidget* handle, int* w, int* h)
 {
@@ -403,9 +1616,20 @@ xydraw_size_allocate (RobWidget* handle, int w, int h)
 static void
 xydraw_clip (cairo_t* cr, void* handle)
 {
-	RobTkXYp* d = (RobTkXYp*)(handle);
+	SpectraUI* ui = (SpectraUI*)handle;
+	RobTkXYp*  d  = ui->xyp;
 	cairo_rectangle (cr, 0, 0, d->w_width, d->w_height);
 	cairo_clip (cr);
+	if (show_waterfall (ui)) {
+		draw_waterfall (ui, cr);
+	} else {
+		/* additional traces, behind the primary one */
+		draw_traces (ui, cr);
+	}
+	draw_status (ui, cr);
+	if (ui->show_stats) {
+		draw_stats (ui, cr);
+	}
 }
 
 static RobWidget*
@@ -418,7 +1642,8 @@ toplevel (SpectraUI* ui, void* const top)
 	ui->xyp = robtk_xydraw_new (800, 400);
 	robwidget_set_size_allocate (ui->xyp->rw, xydraw_size_allocate);
 	robwidget_set_size_request (ui->xyp->rw, xydraw_size_request);
-	robtk_xydraw_set_clip_callback (ui->xyp, xydraw_clip, ui->xyp);
+	robtk_xydraw_set_clip_callback (ui->xyp, xydraw_clip, ui);
+	robwidget_set_mousedown (ui->xyp->rw, xydraw_mousedown);
 
 	robtk_xydraw_set_linewidth (ui->xyp, 1.5);
 	robtk_xydraw_set_drawing_mode (ui->xyp, RobTkXY_ymax_zline);
@@ -431,6 +1656,12 @@ toplevel (SpectraUI* ui, void* const top)
 	robtk_select_add_item (ui->sel_fft, 4096, "4096");
 	robtk_select_add_item (ui->sel_fft, 8192, "8192");
 	robtk_select_add_item (ui->sel_fft, 16384, "16384");
+	robtk_select_add_item (ui->sel_fft, 32768, "32768");
+	robtk_select_add_item (ui->sel_fft, 44100, "44100");
+	robtk_select_add_item (ui->sel_fft, 48000, "48000");
+	robtk_select_add_item (ui->sel_fft, 65536, "65536");
+	robtk_select_add_item (ui->sel_fft, 96000, "96000");
+	robtk_select_add_item (ui->sel_fft, 131072, "131072");
 	robtk_select_set_default_item (ui->sel_fft, 2);
 	robtk_select_set_value (ui->sel_fft, 4096);
 	robtk_select_set_callback (ui->sel_fft, cb_set_fft, ui);
@@ -439,6 +1670,22 @@ toplevel (SpectraUI* ui, void* const top)
 	robtk_cbtn_set_active (ui->btn_color, false);
 	robtk_cbtn_set_callback (ui->btn_color, cb_set_color, ui);
 
+	ui->btn_dsp = robtk_cbtn_new ("DSP FFT", GBT_LED_LEFT, false);
+	robtk_cbtn_set_active (ui->btn_dsp, false);
+	robtk_cbtn_set_callback (ui->btn_dsp, cb_set_dsp, ui);
+
+	ui->btn_multires = robtk_cbtn_new ("Multi-Res", GBT_LED_LEFT, false);
+	robtk_cbtn_set_active (ui->btn_multires, false);
+	robtk_cbtn_set_callback (ui->btn_multires, cb_set_multires, ui);
+
+	ui->btn_waterfall = robtk_cbtn_new ("Waterfall", GBT_LED_LEFT, false);
+	robtk_cbtn_set_active (ui->btn_waterfall, false);
+	robtk_cbtn_set_callback (ui->btn_waterfall, cb_set_waterfall, ui);
+
+	ui->btn_stats = robtk_cbtn_new ("Stats", GBT_LED_LEFT, false);
+	robtk_cbtn_set_active (ui->btn_stats, false);
+	robtk_cbtn_set_callback (ui->btn_stats, cb_set_stats, ui);
+
 	ui->sel_window = robtk_select_new ();
 	robtk_select_add_item (ui->sel_window, W_HANN, "Hann");
 #if 0
@@ -452,6 +1699,82 @@ toplevel (SpectraUI* ui, void* const top)
 	robtk_select_set_item (ui->sel_window, 0);
 	robtk_select_set_callback (ui->sel_window, cb_set_window, ui);
 
+	if (ui->n_channels == 2) {
+		ui->sel_trace = robtk_select_new ();
+		robtk_select_add_item (ui->sel_trace, 0x3, "L+R");
+		robtk_select_add_item (ui->sel_trace, 0xc, "M+S");
+		robtk_select_add_item (ui->sel_trace, 0x1, "L");
+		robtk_select_add_item (ui->sel_trace, 0x2, "R");
+		robtk_select_add_item (ui->sel_trace, 0x4, "M");
+		robtk_select_add_item (ui->sel_trace, 0x8, "S");
+		robtk_select_add_item (ui->sel_trace, 0xf, "All");
+		robtk_select_set_default_item (ui->sel_trace, 0);
+		robtk_select_set_item (ui->sel_trace, 0);
+	} else if (ui->n_channels > 2) {
+		char txt[8];
+		ui->sel_trace = robtk_select_new ();
+		robtk_select_add_item (ui->sel_trace, (1 << ui->n_channels) - 1, "All");
+		for (uint32_t c = 0; c < ui->n_channels; ++c) {
+			sprintf (txt, "%d", c + 1);
+			robtk_select_add_item (ui->sel_trace, 1 << c, txt);
+		}
+		robtk_select_set_default_item (ui->sel_trace, 0);
+		robtk_select_set_item (ui->sel_trace, 0);
+	}
+	if (ui->sel_trace) {
+		const uint32_t t = primary_trace (ui);
+		robtk_xydraw_set_color (ui->xyp, trace_color[t][0], trace_color[t][1], trace_color[t][2], trace_color[t][3]);
+		robtk_select_set_callback (ui->sel_trace, cb_set_trace, ui);
+	}
+
+	ui->sel_overlap = robtk_select_new ();
+	robtk_select_add_item (ui->sel_overlap, 0, "Auto Overlap");
+	robtk_select_add_item (ui->sel_overlap, 1, "No Overlap");
+	robtk_select_add_item (ui->sel_overlap, 2, "50% Overlap");
+	robtk_select_add_item (ui->sel_overlap, 4, "75% Overlap");
+	robtk_select_add_item (ui->sel_overlap, 8, "87.5% Overlap");
+	robtk_select_set_default_item (ui->sel_overlap, 0);
+	robtk_select_set_item (ui->sel_overlap, 0);
+	robtk_select_set_callback (ui->sel_overlap, cb_set_overlap, ui);
+
+	ui->sel_avg = robtk_select_new ();
+	robtk_select_add_item (ui->sel_avg, SPR_AVG (AVG_NONE, 1), "No Avg");
+	robtk_select_add_item (ui->sel_avg, SPR_AVG (AVG_EXP, 4), "Exp Avg 4");
+	robtk_select_add_item (ui->sel_avg, SPR_AVG (AVG_EXP, 16), "Exp Avg 16");
+	robtk_select_add_item (ui->sel_avg, SPR_AVG (AVG_LIN, 4), "Lin Avg 4");
+	robtk_select_add_item (ui->sel_avg, SPR_AVG (AVG_LIN, 16), "Lin Avg 16");
+	robtk_select_set_default_item (ui->sel_avg, 0);
+	robtk_select_set_item (ui->sel_avg, 0);
+	robtk_select_set_callback (ui->sel_avg, cb_set_avg, ui);
+
+	ui->sel_smooth = robtk_select_new ();
+	robtk_select_add_item (ui->sel_smooth, 0, "No Smoothing");
+	robtk_select_add_item (ui->sel_smooth, 1, "1/1 Octave");
+	robtk_select_add_item (ui->sel_smooth, 3, "1/3 Octave");
+	robtk_select_add_item (ui->sel_smooth, 6, "1/6 Octave");
+	robtk_select_add_item (ui->sel_smooth, 12, "1/12 Octave");
+	robtk_select_add_item (ui->sel_smooth, 24, "1/24 Octave");
+	robtk_select_set_default_item (ui->sel_smooth, 0);
+	robtk_select_set_item (ui->sel_smooth, 0);
+	robtk_select_set_callback (ui->sel_smooth, cb_set_smooth, ui);
+
+	ui->sel_peak = robtk_select_new ();
+	for (uint32_t i = 0; i < N_PEAK_MODES; ++i) {
+		robtk_select_add_item (ui->sel_peak, i, peak_modes[i].name);
+	}
+	robtk_select_set_default_item (ui->sel_peak, 0);
+	robtk_select_set_item (ui->sel_peak, 0);
+	robtk_select_set_callback (ui->sel_peak, cb_set_peak, ui);
+
+	ui->sel_zoom = robtk_select_new ();
+	robtk_select_add_item (ui->sel_zoom, 0, "No Zoom");
+	robtk_select_add_item (ui->sel_zoom, 4, "Zoom 16x");
+	robtk_select_add_item (ui->sel_zoom, 6, "Zoom 64x");
+	robtk_select_add_item (ui->sel_zoom, 8, "Zoom 256x");
+	robtk_select_set_default_item (ui->sel_zoom, 0);
+	robtk_select_set_item (ui->sel_zoom, 0);
+	robtk_select_set_callback (ui->sel_zoom, cb_set_zoom, ui);
+
 	ui->sep0 = robtk_sep_new (true);
 	ui->sep1 = robtk_sep_new (true);
 	robtk_sep_set_linewidth (ui->sep0, 0);
@@ -462,8 +1785,20 @@ toplevel (SpectraUI* ui, void* const top)
 	rob_hbox_child_pack (ui->hbox, robtk_sep_widget (ui->sep0), TRUE, FALSE);
 	rob_hbox_child_pack (ui->hbox, robtk_lbl_widget (ui->lbl_fft), FALSE, FALSE);
 	rob_hbox_child_pack (ui->hbox, robtk_select_widget (ui->sel_fft), FALSE, FALSE);
+	rob_hbox_child_pack (ui->hbox, robtk_cbtn_widget (ui->btn_multires), FALSE, FALSE);
+	rob_hbox_child_pack (ui->hbox, robtk_cbtn_widget (ui->btn_waterfall), FALSE, FALSE);
 	rob_hbox_child_pack (ui->hbox, robtk_cbtn_widget (ui->btn_color), FALSE, FALSE);
 	rob_hbox_child_pack (ui->hbox, robtk_select_widget (ui->sel_window), FALSE, FALSE);
+	rob_hbox_child_pack (ui->hbox, robtk_select_widget (ui->sel_overlap), FALSE, FALSE);
+	rob_hbox_child_pack (ui->hbox, robtk_select_widget (ui->sel_avg), FALSE, FALSE);
+	rob_hbox_child_pack (ui->hbox, robtk_select_widget (ui->sel_smooth), FALSE, FALSE);
+	rob_hbox_child_pack (ui->hbox, robtk_select_widget (ui->sel_peak), FALSE, FALSE);
+	rob_hbox_child_pack (ui->hbox, robtk_select_widget (ui->sel_zoom), FALSE, FALSE);
+	rob_hbox_child_pack (ui->hbox, robtk_cbtn_widget (ui->btn_dsp), FALSE, FALSE);
+	if (ui->sel_trace) {
+		rob_hbox_child_pack (ui->hbox, robtk_select_widget (ui->sel_trace), FALSE, FALSE);
+	}
+	rob_hbox_child_pack (ui->hbox, robtk_cbtn_widget (ui->btn_stats), FALSE, FALSE);
 	rob_hbox_child_pack (ui->hbox, robtk_sep_widget (ui->sep1), TRUE, FALSE);
 
 	rob_vbox_child_pack (ui->vbox, robtk_xydraw_widget (ui->xyp), TRUE, TRUE);
@@ -507,17 +1842,35 @@ instantiate (
 
 	if (!strncmp (plugin_uri, SPR_URI "#Mono", 31 + 5)) {
 		ui->n_channels = 1;
+		ui->trace_mask = 0x1;
+	} else if (!strncmp (plugin_uri, SPR_URI "#Stereo", 31 + 7)) {
+		ui->n_channels = 2;
+		ui->trace_mask = 0x3;
+	} else if (!strncmp (plugin_uri, SPR_URI "#Quad", 31 + 5)) {
+		ui->n_channels = 4;
+		ui->trace_mask = 0xf;
 	} else {
 		free (ui);
 		return NULL;
 	}
 
+	const LV2_Extension_Data_Feature* data_access = NULL;
+
 	for (int i = 0; features[i]; ++i) {
 		if (!strcmp (features[i]->URI, LV2_URID_URI "#map")) {
 			ui->map = (LV2_URID_Map*)features[i]->data;
+		} else if (!strcmp (features[i]->URI, LV2_INSTANCE_ACCESS_URI)) {
+			ui->instance = features[i]->data;
+		} else if (!strcmp (features[i]->URI, LV2_DATA_ACCESS_URI)) {
+			data_access = (const LV2_Extension_Data_Feature*)features[i]->data;
 		}
 	}
 
+	/* read raw audio directly from the DSP, if possible */
+	if (ui->instance && data_access) {
+		ui->ring = (const SpectraRingInterface*)data_access->data_access (SPR__ringbuf);
+	}
+
 	if (!ui->map) {
 		fprintf (stderr, "Spectra.lv2 UI: Host does not support urid:map\n");
 		free (ui);
@@ -536,12 +1889,63 @@ instantiate (
 	ui->window_size     = 4096;
 	ui->pink_scale      = false;
 	ui->window_fun      = W_HANN;
+	ui->dsp_fft         = false;
+	ui->multires        = false;
+	ui->zoom            = 0;
+	ui->zoom_center     = 1000;
+	ui->overlap         = 0;
+	ui->averaging       = SPR_AVG (AVG_NONE, 1);
+	ui->smooth          = 0;
+	ui->peak            = 0;
+	ui->waterfall       = false;
+	ui->wf_surf         = NULL;
+	ui->wf_data         = NULL;
+	ui->wf_width        = 0;
+	ui->wf_height       = 0;
+	ui->wf_stride       = 0;
+	ui->wf_row          = 0;
+	ui->wf_col          = NULL;
+	ui->wf_line         = NULL;
+	ui->wf_size         = 0;
 	ui->disable_signals = false;
 
 	map_spectra_uris (ui->map, &ui->uris);
 	lv2_atom_forge_init (&ui->forge, ui->map);
 
+	pthread_mutex_init (&ui->trace_lock, NULL);
+	pthread_mutex_init (&ui->fa_lock, NULL);
+	pthread_cond_init (&ui->fa_signal, NULL);
+
+	const uint32_t n_points = MAX (MAX_POINTS, MAX_DSP_POINTS);
+	ui->col_lut             = (uint32_t*)malloc (MR_STAGES * MAX_FFT_SIZE / 2 * sizeof (uint32_t));
+	fs_init (&ui->fs, MAX_FFT_SIZE / 2);
+	waterfall_lut (ui);
+	for (uint32_t t = 0; t < MAX_TRACES; ++t) {
+		ui->p_x[t] = (float*)malloc (n_points * sizeof (float));
+		ui->p_y[t] = (float*)malloc (n_points * sizeof (float));
+		ui->q_x[t] = (float*)malloc (n_points * sizeof (float));
+		ui->q_y[t] = (float*)malloc (n_points * sizeof (float));
+		ui->pk_x[t] = (float*)malloc (MAX_POINTS * sizeof (float));
+		ui->pk_y[t] = (float*)malloc (MAX_POINTS * sizeof (float));
+		ui->qk_x[t] = (float*)malloc (MAX_POINTS * sizeof (float));
+		ui->qk_y[t] = (float*)malloc (MAX_POINTS * sizeof (float));
+		ui->pk_n[t] = 0;
+		ui->qk_n[t] = 0;
+	}
+	for (uint32_t c = 0; c < ui->n_channels; ++c) {
+		ui->an_ring[c] = spr_ring_new (AN_RINGSIZE);
+		ui->an_buf[c]  = (float*)malloc (AN_BUFSIZE * sizeof (float));
+	}
+
 	reinitialize_fft (ui);
+	pthread_create (&ui->fa_thread, NULL, fa_builder, ui);
+
+	ui->fz = (struct FFTZoom*)malloc (sizeof (struct FFTZoom));
+	fftz_init (ui->fz, ZOOM_FFT_SIZE, ui->n_channels, ui->rate, 60);
+
+	pthread_mutex_init (&ui->an_lock, NULL);
+	pthread_cond_init (&ui->an_signal, NULL);
+	pthread_create (&ui->an_thread, NULL, analysis_thread, ui);
 
 	*widget = toplevel (ui, ui_toplevel);
 	ui_enable (ui);
@@ -569,15 +1973,68 @@ cleanup (LV2UI_Handle handle)
 	robtk_sep_destroy (ui->sep0);
 	robtk_sep_destroy (ui->sep1);
 	robtk_cbtn_destroy (ui->btn_color);
+	robtk_cbtn_destroy (ui->btn_dsp);
+	robtk_cbtn_destroy (ui->btn_multires);
+	robtk_cbtn_destroy (ui->btn_waterfall);
+	robtk_cbtn_destroy (ui->btn_stats);
+	if (ui->sel_trace) {
+		robtk_select_destroy (ui->sel_trace);
+	}
 	robtk_select_destroy (ui->sel_fft);
 	robtk_select_destroy (ui->sel_window);
+	robtk_select_destroy (ui->sel_overlap);
+	robtk_select_destroy (ui->sel_avg);
+	robtk_select_destroy (ui->sel_smooth);
+	robtk_select_destroy (ui->sel_peak);
+	robtk_select_destroy (ui->sel_zoom);
 	robtk_lbl_destroy (ui->lbl_fft);
 
 	rob_box_destroy (ui->hbox);
 	rob_box_destroy (ui->vbox);
+	pthread_mutex_lock (&ui->an_lock);
+	ui->an_exit = true;
+	pthread_cond_signal (&ui->an_signal);
+	pthread_mutex_unlock (&ui->an_lock);
+	pthread_join (ui->an_thread, NULL);
+	pthread_cond_destroy (&ui->an_signal);
+	pthread_mutex_destroy (&ui->an_lock);
+
+	pthread_mutex_lock (&ui->fa_lock);
+	ui->fa_exit = true;
+	pthread_cond_signal (&ui->fa_signal);
+	pthread_mutex_unlock (&ui->fa_lock);
+	pthread_join (ui->fa_thread, NULL);
+	pthread_cond_destroy (&ui->fa_signal);
+	pthread_mutex_destroy (&ui->fa_lock);
+
+	fftx_free (ui->fa_next);
 	fftx_free (ui->fa);
-	free (ui->p_x);
-	free (ui->p_y);
+	fftz_free (ui->fz);
+	fftx_window_release (ui->window_ref);
+	fftx_window_release (ui->zwindow_ref);
+	free (ui->col_lut);
+	fs_free (&ui->fs);
+	if (ui->wf_surf) {
+		cairo_surface_destroy (ui->wf_surf);
+	}
+	free (ui->wf_col);
+	free (ui->wf_line);
+	for (uint32_t t = 0; t < MAX_TRACES; ++t) {
+		free (ui->p_x[t]);
+		free (ui->p_y[t]);
+		free (ui->q_x[t]);
+		free (ui->q_y[t]);
+		free (ui->pk_x[t]);
+		free (ui->pk_y[t]);
+		free (ui->qk_x[t]);
+		free (ui->qk_y[t]);
+	}
+	for (uint32_t c = 0; c < MAX_CHANNELS; ++c) {
+		free (ui->chn_buf[c]);
+		free (ui->an_buf[c]);
+		spr_ring_free (ui->an_ring[c]);
+	}
+	pthread_mutex_destroy (&ui->trace_lock);
 
 	free (ui);
 }
@@ -592,6 +2049,9 @@ cleanup (LV2UI_Handle handle)
  * empties this ringbuffer by sending port_event()s to the UI at some
  * random time later.  When CPU and DSP load are large the host-buffer
  * may overflow and some events may get lost.
+ * (If the host provides instance- and data-access, raw audio is read
+ * directly from the DSP's ringbuffer, and only a small notification
+ * is passed through the host-buffer).
  *
  * This thread does is not [usually] the 'drawing' thread (it does not
  * have X11 or gl context).
@@ -606,6 +2066,8 @@ port_event (LV2UI_Handle handle,
 	SpectraUI* ui   = (SpectraUI*)handle;
 	LV2_Atom*  atom = (LV2_Atom*)buffer;
 
+	++ui->st_events;
+
 	/* check type of data received
    *  format == 0: [float] control-port event
    *  format > 0: message
@@ -637,44 +2099,177 @@ port_event (LV2UI_Handle handle,
 		LV2_Atom_Object* obj = (LV2_Atom_Object*)atom;
 		LV2_Atom*        a0  = NULL;
 		LV2_Atom*        a1  = NULL;
+		LV2_Atom*        a2  = NULL;
+		LV2_Atom*        a3  = NULL;
+		LV2_Atom*        a4  = NULL;
+		LV2_Atom*        a5  = NULL;
+		LV2_Atom*        a6  = NULL;
+		LV2_Atom*        a7  = NULL;
+		LV2_Atom*        a8  = NULL;
+		LV2_Atom*        a9  = NULL;
+		LV2_Atom*        a10 = NULL;
 		if (
 		    /* handle raw-audio data objects */
 		    obj->body.otype == ui->uris.rawaudio
 		    /* retrieve properties from object and
 				 * check that there the [here] two required properties are set.. */
-				&& 2 == lv2_atom_object_get (obj, ui->uris.channelid, &a0, ui->uris.audiodata, &a1, NULL)
+		    && 2 <= lv2_atom_object_get (obj, ui->uris.channelid, &a0, ui->uris.audiodata, &a1, ui->uris.audiobfp, &a2,
+		                                 ui->uris.framepos, &a3, NULL)
 		    /* ..and non-null.. */
-		    && a0 && a1
+		    && a0 && (a1 || a2)
 		    /* ..and match the expected type */
-		    && a0->type == ui->uris.atom_Int && a1->type == ui->uris.atom_Vector) {
+		    && a0->type == ui->uris.atom_Int) {
 			/* single integer value can be directly dereferenced */
 			const int32_t chn = ((LV2_Atom_Int*)a0)->body;
-
-			/* dereference and typecast vector pointer */
+			/* position in the raw audio stream, if known */
+			const int64_t pos = (a3 && a3->type == ui->uris.atom_Long) ? ((LV2_Atom_Long*)a3)->body : -1;
+
+			if (a1 && a1->type == ui->uris.atom_Vector) {
+				/* dereference and typecast vector pointer */
+				LV2_Atom_Vector* vof = (LV2_Atom_Vector*)LV2_ATOM_BODY (a1);
+				/* check if atom is indeed a vector of the expected type*/
+				if (vof->atom.type == ui->uris.atom_Float) {
+					/* get number of elements in vector
+					 * = (raw 8bit data-length - header-length) / sizeof(expected data type:float) */
+					const size_t n_elem = (a1->size - sizeof (LV2_Atom_Vector_Body)) / vof->atom.size;
+					/* typecast, dereference pointer to vector */
+					const float* data = (float*)LV2_ATOM_BODY (&vof->atom);
+					/* call function that handles the actual data */
+					raw_position (ui, pos, n_elem);
+					update_spectrum (ui, chn, n_elem, data);
+				}
+			} else if (a2 && a2->type == ui->uris.atom_Chunk) {
+				/* block floating point encoded audio, decode to float */
+				const uint32_t n_elem = bfp_samples (a2->size);
+				float*         buf    = chn >= 0 && chn < (int32_t)ui->n_channels ? chn_buffer (ui, chn, n_elem) : NULL;
+				if (buf) {
+					bfp_decode (buf, (int16_t const*)LV2_ATOM_BODY (a2), n_elem);
+					raw_position (ui, pos, n_elem);
+					update_spectrum (ui, chn, n_elem, buf);
+				}
+			}
+		} else if (obj->body.otype == ui->uris.silence) {
+			input_silent (ui);
+		} else if (obj->body.otype == ui->uris.dspstats) {
+			lv2_atom_object_get (obj, ui->uris.forged, &a0, ui->uris.capdrops, &a1, NULL);
+			if (a0 && a0->type == ui->uris.atom_Vector) {
+				LV2_Atom_Vector* vof = (LV2_Atom_Vector*)LV2_ATOM_BODY (a0);
+				if (vof->atom.type == ui->uris.atom_Long && a0->size == sizeof (LV2_Atom_Vector_Body) + sizeof (SpectraHist)) {
+					memcpy (&ui->st_forged, LV2_ATOM_BODY (&vof->atom), sizeof (SpectraHist));
+				}
+			}
+			if (a1 && a1->type == ui->uris.atom_Long) {
+				ui->st_capacity = ((LV2_Atom_Long*)a1)->body;
+			}
+		} else if (obj->body.otype == ui->uris.ringdata && ui->ring) {
+			/* raw audio is available in the DSP's ringbuffer */
+			float*   d[MAX_CHANNELS];
+			uint32_t n = ui->ring->read_space (ui->instance);
+			for (uint32_t c = 0; c < ui->n_channels; ++c) {
+				if (!(d[c] = chn_buffer (ui, c, n))) {
+					return;
+				}
+			}
+			n = ui->ring->read (ui->instance, d, n);
+			/* the ring outlives the UI, when it is re-opened the first
+			 * read may include stale audio from before. It is discarded. */
+			for (uint32_t c = 0; c < ui->n_channels && ui->frame_valid; ++c) {
+				update_spectrum (ui, c, n, d[c]);
+			}
+			/* the DSP drops audio when the ringbuffer is full,
+			 * which is after all data that was available before */
+			if (1 == lv2_atom_object_get (obj, ui->uris.dropped, &a0, NULL) && a0 && a0->type == ui->uris.atom_Long) {
+				const int64_t dropped = ((LV2_Atom_Long*)a0)->body;
+				if (ui->frame_valid && dropped > ui->ring_dropped) {
+					raw_gap (ui, dropped - ui->ring_dropped);
+				}
+				ui->ring_dropped = dropped;
+			}
+			ui->frame_valid = true;
+		} else if (
+		    /* handle spectra analyzed by the DSP */
+		    obj->body.otype == ui->uris.spectrum
+		    && 2 == lv2_atom_object_get (obj, ui->uris.channelid, &a0, ui->uris.bandpower, &a1, NULL)
+		    && a0 && a1
+		    && a0->type == ui->uris.atom_Int && a1->type == ui->uris.atom_Vector) {
+			const int32_t    chn = ((LV2_Atom_Int*)a0)->body;
 			LV2_Atom_Vector* vof = (LV2_Atom_Vector*)LV2_ATOM_BODY (a1);
-			/* check if atom is indeed a vector of the expected type*/
 			if (vof->atom.type == ui->uris.atom_Float) {
-				/* get number of elements in vector
-				 * = (raw 8bit data-length - header-length) / sizeof(expected data type:float) */
 				const size_t n_elem = (a1->size - sizeof (LV2_Atom_Vector_Body)) / vof->atom.size;
-				/* typecast, dereference pointer to vector */
-				const float* data = (float*)LV2_ATOM_BODY (&vof->atom);
-				/* call function that handles the actual data */
-				update_spectrum (ui, chn, n_elem, data);
+				const float* data   = (float*)LV2_ATOM_BODY (&vof->atom);
+				update_bands (ui, chn, n_elem, data);
 			}
 		} else if (
 		    /* handle 'state/settings' data object */
 		    obj->body.otype == ui->uris.ui_state
 		    /* retrieve properties from object and
 				 * check that there the [here] three required properties are set.. */
-				&& 1 == lv2_atom_object_get (obj, ui->uris.samplerate, &a0, NULL)
+				&& 1 <= lv2_atom_object_get (obj, ui->uris.samplerate, &a0, ui->uris.dspfft, &a1, ui->uris.traces, &a2,
+				                        ui->uris.overlap, &a3, ui->uris.averaging, &a4,
+				                        ui->uris.multires, &a5, ui->uris.zoom, &a6, ui->uris.zoomfreq, &a7,
+				                        ui->uris.smoothing, &a8, ui->uris.peak, &a9,
+				                        ui->uris.waterfall, &a10, NULL)
 		    /* ..and non-null.. */
 		    && a0
 		    /* ..and match the expected type */
 		    && a0->type == ui->uris.atom_Float) {
-			ui->rate = ((LV2_Atom_Float*)a0)->body;
-			reinitialize_fft (ui);
-			draw_scales (ui);
+			const float rate = ((LV2_Atom_Float*)a0)->body;
+			if (ui->rate != rate) {
+				ui->rate = rate;
+				reinitialize_fft (ui);
+				draw_scales (ui);
+			}
+			if (a1 && a1->type == ui->uris.atom_Int) {
+				const int32_t n_points = ((LV2_Atom_Int*)a1)->body;
+				ui->disable_signals    = true;
+				robtk_cbtn_set_sensitive (ui->btn_dsp, n_points >= 0);
+				robtk_cbtn_set_active (ui->btn_dsp, n_points > 0);
+				ui->disable_signals = false;
+			}
+			if (a2 && a2->type == ui->uris.atom_Int && ui->sel_trace && ((LV2_Atom_Int*)a2)->body > 0) {
+				ui->disable_signals = true;
+				robtk_select_set_value (ui->sel_trace, ((LV2_Atom_Int*)a2)->body);
+				ui->disable_signals = false;
+			}
+			if (a3 && a3->type == ui->uris.atom_Int) {
+				ui->disable_signals = true;
+				robtk_select_set_value (ui->sel_overlap, ((LV2_Atom_Int*)a3)->body);
+				ui->disable_signals = false;
+			}
+			if (a4 && a4->type == ui->uris.atom_Int && ((LV2_Atom_Int*)a4)->body > 0) {
+				ui->disable_signals = true;
+				robtk_select_set_value (ui->sel_avg, ((LV2_Atom_Int*)a4)->body);
+				ui->disable_signals = false;
+			}
+			if (a5 && a5->type == ui->uris.atom_Int) {
+				ui->disable_signals = true;
+				robtk_cbtn_set_active (ui->btn_multires, ((LV2_Atom_Int*)a5)->body > 0);
+				ui->disable_signals = false;
+			}
+			if (a7 && a7->type == ui->uris.atom_Float && ((LV2_Atom_Float*)a7)->body > 0) {
+				set_zoom_center (ui, ((LV2_Atom_Float*)a7)->body);
+				__atomic_store_n (&ui->scales_dirty, true, __ATOMIC_RELEASE);
+			}
+			if (a6 && a6->type == ui->uris.atom_Int) {
+				ui->disable_signals = true;
+				robtk_select_set_value (ui->sel_zoom, ((LV2_Atom_Int*)a6)->body);
+				ui->disable_signals = false;
+			}
+			if (a8 && a8->type == ui->uris.atom_Int) {
+				ui->disable_signals = true;
+				robtk_select_set_value (ui->sel_smooth, ((LV2_Atom_Int*)a8)->body);
+				ui->disable_signals = false;
+			}
+			if (a9 && a9->type == ui->uris.atom_Int) {
+				ui->disable_signals = true;
+				robtk_select_set_value (ui->sel_peak, ((LV2_Atom_Int*)a9)->body);
+				ui->disable_signals = false;
+			}
+			if (a10 && a10->type == ui->uris.atom_Int) {
+				ui->disable_signals = true;
+				robtk_cbtn_set_active (ui->btn_waterfall, ((LV2_Atom_Int*)a10)->body > 0);
+				ui->disable_signals = false;
+			}
 		}
 	}
 }
@@ -0,0 +1,122 @@
+/* simple spectrum analyzer
+ *
+ * Copyright (C) 2013 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPR_BFP_H
+#define SPR_BFP_H
+
+#include <math.h>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* block floating point audio encoding
+ *
+ * every block of BFP_BLOCK samples is stored as one int16 exponent
+ * followed by BFP_BLOCK int16 mantissas, relative to the block's peak.
+ * 15 bit mantissas give ~90dB dynamic range per block, which is
+ * sufficient for display purposes and halves the bandwidth.
+ */
+#define BFP_BLOCK (64)
+
+/** number of bytes required to encode n_samples */
+static inline uint32_t
+bfp_size (uint32_t n_samples)
+{
+	const uint32_t n_blocks = (n_samples + BFP_BLOCK - 1) / BFP_BLOCK;
+	return sizeof (int16_t) * (n_samples + n_blocks);
+}
+
+/** number of samples in an encoded buffer of the given size */
+static inline uint32_t
+bfp_samples (uint32_t n_bytes)
+{
+	const uint32_t bsize = sizeof (int16_t) * (BFP_BLOCK + 1);
+	const uint32_t rem   = n_bytes % bsize;
+	return (n_bytes / bsize) * BFP_BLOCK + (rem > sizeof (int16_t) ? rem / sizeof (int16_t) - 1 : 0);
+}
+
+/** encode n_samples into dst, returns number of int16 written */
+static inline uint32_t
+bfp_encode (int16_t* dst, float const* src, uint32_t n_samples)
+{
+	uint32_t n = 0;
+	for (uint32_t off = 0; off < n_samples; off += BFP_BLOCK) {
+		const uint32_t ns = n_samples - off < BFP_BLOCK ? n_samples - off : BFP_BLOCK;
+		float const*   s  = &src[off];
+		float          pk = 0;
+		for (uint32_t i = 0; i < ns; ++i) {
+			const float a = fabsf (s[i]);
+			pk            = a > pk ? a : pk;
+		}
+		int e;
+		frexpf (pk, &e);
+		/* keep the scale finite, 2^(15 + 110) < FLT_MAX; blocks below 2^-110
+		 * (-660dBFS) are encoded as zero */
+		e                 = e < -110 ? -110 : (e > 120 ? 120 : e);
+		const float scale = ldexpf (1.f, 15 - e);
+		int16_t*    m     = &dst[n + 1];
+		dst[n]            = e;
+		uint32_t i        = 0;
+#ifdef __SSE2__
+		const __m128 vs = _mm_set1_ps (scale);
+		for (; i + 8 <= ns; i += 8) {
+			/* packs saturates, in case rounding exceeds 32767 */
+			const __m128i lo = _mm_cvtps_epi32 (_mm_mul_ps (_mm_loadu_ps (&s[i]), vs));
+			const __m128i hi = _mm_cvtps_epi32 (_mm_mul_ps (_mm_loadu_ps (&s[i + 4]), vs));
+			_mm_storeu_si128 ((__m128i*)&m[i], _mm_packs_epi32 (lo, hi));
+		}
+#endif
+		for (; i < ns; ++i) {
+			const long v = lrintf (s[i] * scale);
+			m[i]         = v > 32767 ? 32767 : (v < -32768 ? -32768 : v);
+		}
+		n += ns + 1;
+	}
+	return n;
+}
+
+/** decode n_samples from src into dst */
+static inline void
+bfp_decode (float* dst, int16_t const* src, uint32_t n_samples)
+{
+	for (uint32_t off = 0; off < n_samples; off += BFP_BLOCK) {
+		const uint32_t ns    = n_samples - off < BFP_BLOCK ? n_samples - off : BFP_BLOCK;
+		const float    scale = ldexpf (1.f, src[0] - 15);
+		int16_t const* m     = &src[1];
+		float*         d     = &dst[off];
+		uint32_t       i     = 0;
+#ifdef __SSE2__
+		const __m128 vs = _mm_set1_ps (scale);
+		for (; i + 8 <= ns; i += 8) {
+			const __m128i v  = _mm_loadu_si128 ((__m128i const*)&m[i]);
+			const __m128i lo = _mm_srai_epi32 (_mm_unpacklo_epi16 (v, v), 16);
+			const __m128i hi = _mm_srai_epi32 (_mm_unpackhi_epi16 (v, v), 16);
+			_mm_storeu_ps (&d[i], _mm_mul_ps (_mm_cvtepi32_ps (lo), vs));
+			_mm_storeu_ps (&d[i + 4], _mm_mul_ps (_mm_cvtepi32_ps (hi), vs));
+		}
+#endif
+		for (; i < ns; ++i) {
+			d[i] = m[i] * scale;
+		}
+		src += ns + 1;
+	}
+}
+
+#endif
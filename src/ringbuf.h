@@ -0,0 +1,136 @@
+/* simple spectrum analyzer
+ *
+ * Copyright (C) 2013 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPR_RINGBUF_H
+#define SPR_RINGBUF_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* lock-free single-producer, single-consumer ringbuffer of float samples.
+ *
+ * read/write positions are free-running counters; the buffer size
+ * is a power of two, so wrap-around is a simple mask.
+ */
+typedef struct {
+	float*   buf;
+	uint32_t size;
+	uint32_t mask;
+	uint32_t wp; /* only modified by the producer */
+	uint32_t rp; /* only modified by the consumer */
+} SpectraRing;
+
+static inline SpectraRing*
+spr_ring_new (uint32_t size)
+{
+	SpectraRing* rb = (SpectraRing*)calloc (1, sizeof (SpectraRing));
+	if (!rb) {
+		return NULL;
+	}
+	uint32_t power_of_two;
+	for (power_of_two = 1; 1U << power_of_two < size; ++power_of_two) ;
+	rb->size = 1U << power_of_two;
+	rb->mask = rb->size - 1;
+	rb->buf  = (float*)calloc (rb->size, sizeof (float));
+	if (!rb->buf) {
+		free (rb);
+		return NULL;
+	}
+	return rb;
+}
+
+static inline void
+spr_ring_free (SpectraRing* rb)
+{
+	if (!rb) {
+		return;
+	}
+	free (rb->buf);
+	free (rb);
+}
+
+static inline uint32_t
+spr_ring_read_space (SpectraRing* rb)
+{
+	const uint32_t w = __atomic_load_n (&rb->wp, __ATOMIC_ACQUIRE);
+	return w - rb->rp;
+}
+
+static inline uint32_t
+spr_ring_write_space (SpectraRing* rb)
+{
+	const uint32_t r = __atomic_load_n (&rb->rp, __ATOMIC_ACQUIRE);
+	return rb->size - (rb->wp - r);
+}
+
+/** write up to n samples, returns the number of samples written */
+static inline uint32_t
+spr_ring_write (SpectraRing* rb, float const* data, uint32_t n)
+{
+	const uint32_t space = spr_ring_write_space (rb);
+	if (n > space) {
+		n = space;
+	}
+	const uint32_t w  = rb->wp & rb->mask;
+	const uint32_t n1 = (w + n > rb->size) ? rb->size - w : n;
+	memcpy (&rb->buf[w], data, n1 * sizeof (float));
+	if (n > n1) {
+		memcpy (rb->buf, &data[n1], (n - n1) * sizeof (float));
+	}
+	__atomic_store_n (&rb->wp, rb->wp + n, __ATOMIC_RELEASE);
+	return n;
+}
+
+/** write up to n zero samples, returns the number of samples written */
+static inline uint32_t
+spr_ring_write_zero (SpectraRing* rb, uint32_t n)
+{
+	const uint32_t space = spr_ring_write_space (rb);
+	if (n > space) {
+		n = space;
+	}
+	const uint32_t w  = rb->wp & rb->mask;
+	const uint32_t n1 = (w + n > rb->size) ? rb->size - w : n;
+	memset (&rb->buf[w], 0, n1 * sizeof (float));
+	if (n > n1) {
+		memset (rb->buf, 0, (n - n1) * sizeof (float));
+	}
+	__atomic_store_n (&rb->wp, rb->wp + n, __ATOMIC_RELEASE);
+	return n;
+}
+
+/** read up to n samples, returns the number of samples read */
+static inline uint32_t
+spr_ring_read (SpectraRing* rb, float* data, uint32_t n)
+{
+	const uint32_t avail = spr_ring_read_space (rb);
+	if (n > avail) {
+		n = avail;
+	}
+	const uint32_t r  = rb->rp & rb->mask;
+	const uint32_t n1 = (r + n > rb->size) ? rb->size - r : n;
+	memcpy (data, &rb->buf[r], n1 * sizeof (float));
+	if (n > n1) {
+		memcpy (&data[n1], rb->buf, (n - n1) * sizeof (float));
+	}
+	__atomic_store_n (&rb->rp, rb->rp + n, __ATOMIC_RELEASE);
+	return n;
+}
+
+#endif
@@ -0,0 +1,108 @@
+/* simple spectrum analyzer
+ *
+ * Copyright (C) 2013 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPR_SILENCE_H
+#define SPR_SILENCE_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+/* silence detection, with hysteresis.
+ *
+ * The input is considered silent once the peak of all channels remained
+ * below SPR_SILENCE_ENTER for `hold` samples, and active again as soon
+ * as a single sample exceeds SPR_SILENCE_LEAVE.
+ * Both are below the lowest level the GUI can display (-92dBFS).
+ */
+#define SPR_SILENCE_ENTER (1e-5f)     /* -100 dBFS */
+#define SPR_SILENCE_LEAVE (1.585e-5f) /* -96 dBFS */
+
+typedef struct {
+	bool     silent;
+	uint32_t quiet; /* consecutive samples below threshold */
+} SpectraSilence;
+
+static inline void
+spr_silence_reset (SpectraSilence* s)
+{
+	s->silent = false;
+	s->quiet  = 0;
+}
+
+/** absolute peak of n samples */
+static inline float
+spr_peak (float const* d, uint32_t n)
+{
+	float    pk = 0;
+	uint32_t i  = 0;
+#ifdef __SSE__
+	/* clear the sign-bit */
+	const __m128 sign = _mm_set1_ps (-0.f);
+	__m128       vpk  = _mm_setzero_ps ();
+	for (; i + 4 <= n; i += 4) {
+		vpk = _mm_max_ps (vpk, _mm_andnot_ps (sign, _mm_loadu_ps (&d[i])));
+	}
+	vpk = _mm_max_ps (vpk, _mm_movehl_ps (vpk, vpk));
+	vpk = _mm_max_ss (vpk, _mm_shuffle_ps (vpk, vpk, 1));
+	pk  = _mm_cvtss_f32 (vpk);
+#endif
+	for (; i < n; ++i) {
+		const float a = fabsf (d[i]);
+		pk            = a > pk ? a : pk;
+	}
+	return pk;
+}
+
+/** process n_samples of every channel,
+ * returns true if the input just became silent */
+static inline bool
+spr_silence_run (SpectraSilence* s, float const* const* data, uint32_t n_channels, uint32_t n_samples, uint32_t hold)
+{
+	float pk = 0;
+	for (uint32_t c = 0; c < n_channels; ++c) {
+		const float p = spr_peak (data[c], n_samples);
+		pk            = p > pk ? p : pk;
+	}
+
+	if (s->silent) {
+		if (pk > SPR_SILENCE_LEAVE) {
+			s->silent = false;
+			s->quiet  = 0;
+		}
+		return false;
+	}
+
+	if (pk >= SPR_SILENCE_ENTER) {
+		s->quiet = 0;
+		return false;
+	}
+
+	s->quiet += n_samples;
+	if (s->quiet < hold) {
+		return false;
+	}
+	s->silent = true;
+	return true;
+}
+
+#endif
@@ -21,19 +21,51 @@
 #define _GNU_SOURCE
 #endif
 
+#include <assert.h>
+#include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifdef HAVE_LV2_1_18_6
 #include <lv2/core/lv2.h>
+#include <lv2/worker/worker.h>
 #else
+#include <lv2/lv2plug.in/ns/ext/worker/worker.h>
 #include <lv2/lv2plug.in/ns/lv2core/lv2.h>
 #endif
 
+#include "./bfp.h"
+#include "./ringbuf.h"
+#include "./silence.h"
+#include "./stats.h"
+#include "./tones.h"
 #include "./uris.h"
 
-static bool printed_capacity_warning = false;
+#include "../gui/fft.c"
+
+#ifndef MAX
+#define MAX(A, B) ((A) > (B) ? (A) : (B))
+#endif
+
+/* rate at which spectra are sent to the UI, when analyzing in the DSP */
+#define DSP_FPS (30)
+/* per channel sample-buffer between run() and the worker */
+#define DSP_RINGSIZE (32768)
+#define DSP_WBUFSIZE (8192)
+/* samples encoded at a time, must be a multiple of BFP_BLOCK */
+#define BFP_CHUNK (4096)
+/* max raw audio per channel, collected and sent to the UI at once */
+#define RAW_ACCSIZE (8192)
+/* per channel sample-buffer between run() and the UI, see SpectraRingInterface */
+#define UI_RINGSIZE (32768)
+/* silence in seconds, after which raw audio is no longer sent */
+#define SILENCE_HOLD (.5)
+/* notify port space reserved for the ui_state object */
+#define UI_STATE_SIZE (384)
+/* notify port space of the dspstats object, sent once a second */
+#define STATS_SIZE (384)
 
 typedef struct {
 	/* I/O ports */
@@ -41,6 +73,10 @@ typedef struct {
 	float*                   output[MAX_CHANNELS];
 	const LV2_Atom_Sequence* control;
 	LV2_Atom_Sequence*       notify;
+	float const*             p_fftsize;
+	float const*             p_weight;
+	float const*             p_window;
+	float*                   p_desc[SPR_N_DESC];
 
 	/* atom-forge and URI mapping */
 	LV2_URID_Map*        map;
@@ -49,17 +85,87 @@ typedef struct {
 	LV2_Atom_Forge_Frame frame;
 
 	uint32_t n_channels;
+	uint32_t n_traces;
 	double   rate;
 
 	/* the state of the UI is stored here, so that
    * the GUI can be displayed & closed
    * without loosing current settings.
    */
-	bool ui_active;
-	bool send_settings_to_ui;
+	bool    ui_active;
+	bool    send_settings_to_ui;
+	int32_t         dsp_points; /* > 0: analyze in the DSP, send spectra to the UI */
+	int32_t         trace_mask; /* visible traces, retained for the UI */
+	int32_t         overlap;    /* analysis overlap, see fftx_set_overlap() */
+	int32_t         averaging;  /* see SPR_AVG() */
+	int32_t         multires;   /* multi-resolution display, retained for the UI */
+	int32_t         zoom;       /* zoom factor, retained for the UI */
+	float           zoom_freq;  /* zoom center frequency, retained for the UI */
+	int32_t         smoothing;  /* 1/n octave smoothing, retained for the UI */
+	int32_t         peak;       /* peak-hold mode, retained for the UI */
+	int32_t         waterfall;  /* waterfall display, retained for the UI */
+	SpectraEncoding encoding;   /* raw audio format the UI can decode */
+	int16_t         bfp_buf[BFP_CHUNK + BFP_CHUNK / BFP_BLOCK];
+
+	/* raw audio is collected here and sent once per UI frame,
+	 * independent of the host's period-size */
+	float    acc[MAX_CHANNELS][RAW_ACCSIZE];
+	uint32_t acc_n;
+	uint32_t acc_size;
+
+	/* samples collected for the UI (sent or not), and samples that
+	 * did not fit into the uiring. The UI uses these to detect gaps. */
+	int64_t raw_pos;
+	int64_t raw_dropped;
+
+	/* no raw audio is sent while the input is silent */
+	SpectraSilence silence;
+
+	/* raw audio read directly by the UI (SPR_ENC_RING) */
+	SpectraRing* uiring[MAX_CHANNELS];
+
+	/* DSP-side analysis, performed in the worker thread */
+	LV2_Worker_Schedule* schedule;
+	SpectraRing*         ring[MAX_CHANNELS];
+	float*               wbuf[MAX_CHANNELS];
+	struct FFTAnalysis*  fa;
+	struct FFTLogscale   fl;
+	uint32_t*            band;
+	uint32_t             n_bands;
+	uint32_t             hop;
+	bool                 work_pending;
+	uint32_t             spec_points;
+	float                spec[MAX_TRACES][MAX_DSP_POINTS];
+	float                desc[SPR_N_DESC]; /* most recent descriptors */
+
+	/* tone monitor, configured by the host or UI, see tones.h */
+	SpectraTones tones;
+	float        tone_time;
+
+	/* instrumentation, sent to the UI, see tx_stats() */
+	SpectraHist st_forged;   /* bytes per cycle */
+	uint64_t    st_capacity; /* cycles skipped, notify port too small */
+	uint32_t    st_time;     /* samples since the last report */
 
 } Spectra;
 
+/* message from run() to the worker */
+typedef struct {
+	uint32_t fft_size;
+	uint32_t n_points; /* 0: only compute descriptors */
+	window_t window;
+	uint32_t overlap;
+	int32_t  averaging;
+	bool     pink;
+} SpectraWork;
+
+/* response of the worker */
+typedef struct {
+	uint32_t n_points;
+	bool     analyzed;
+	float    desc[SPR_N_DESC];
+} SpectraWorkResponse;
+
 static LV2_Handle
 instantiate (const LV2_Descriptor*     descriptor,
              double                    rate,
@@ -78,6 +184,8 @@ instantiate (const LV2_Descriptor*     descriptor,
 	for (i = 0; features[i]; ++i) {
 		if (!strcmp (features[i]->URI, LV2_URID__map)) {
 			self->map = (LV2_URID_Map*)features[i]->data;
+		} else if (!strcmp (features[i]->URI, LV2_WORKER__schedule)) {
+			self->schedule = (LV2_Worker_Schedule*)features[i]->data;
 		}
 	}
 
@@ -89,6 +197,10 @@ instantiate (const LV2_Descriptor*     descriptor,
 
 	if (!strncmp (descriptor->URI, SPR_URI "#Mono", 31 + 5)) {
 		self->n_channels = 1;
+	} else if (!strncmp (descriptor->URI, SPR_URI "#Stereo", 31 + 7)) {
+		self->n_channels = 2;
+	} else if (!strncmp (descriptor->URI, SPR_URI "#Quad", 31 + 5)) {
+		self->n_channels = 4;
 	} else {
 		free (self);
 		return NULL;
@@ -96,9 +208,58 @@ instantiate (const LV2_Descriptor*     descriptor,
 
 	assert (self->n_channels <= MAX_CHANNELS);
 
+	/* stereo analysis also yields mid and side */
+	self->n_traces = self->n_channels == 2 ? 4 : self->n_channels;
+	assert (self->n_traces <= MAX_TRACES);
+
 	self->ui_active           = false;
 	self->send_settings_to_ui = false;
+	self->dsp_points          = 0;
+	self->trace_mask          = 0;
+	self->overlap             = 0;
+	self->averaging           = 0;
+	self->multires            = 0;
+	self->zoom                = 0;
+	self->zoom_freq           = 1000;
+	self->smoothing           = 0;
+	self->peak                = 0;
+	self->waterfall           = 0;
+	self->encoding            = SPR_ENC_FLOAT;
 	self->rate                = rate;
+	self->hop                 = ceil (rate / DSP_FPS);
+	self->acc_n               = 0;
+	self->acc_size            = MIN (RAW_ACCSIZE, self->hop);
+	spr_silence_reset (&self->silence);
+	self->desc[SPR_DESC_RMS]  = -120;
+	self->tone_time           = .1;
+	spr_tones_set (&self->tones, rate, NULL, 0, self->tone_time);
+
+	for (uint32_t c = 0; c < self->n_channels; ++c) {
+		self->uiring[c] = spr_ring_new (UI_RINGSIZE);
+		if (!self->uiring[c]) {
+			for (uint32_t k = 0; k < c; ++k) {
+				spr_ring_free (self->uiring[k]);
+			}
+			free (self);
+			return NULL;
+		}
+	}
+
+	if (self->schedule) {
+		for (uint32_t c = 0; c < self->n_channels; ++c) {
+			self->ring[c] = spr_ring_new (DSP_RINGSIZE);
+			self->wbuf[c] = (float*)malloc (DSP_WBUFSIZE * sizeof (float));
+			if (!self->ring[c] || !self->wbuf[c]) {
+				for (uint32_t k = 0; k < self->n_channels; ++k) {
+					spr_ring_free (self->uiring[k]);
+					spr_ring_free (self->ring[k]);
+					free (self->wbuf[k]);
+				}
+				free (self);
+				return NULL;
+			}
+		}
+	}
 
 	lv2_atom_forge_init (&self->forge, self->map);
 	map_spectra_uris (self->map, &self->uris);
@@ -119,14 +280,25 @@ connect_port (LV2_Handle handle,
 		case SPR_NOTIFY:
 			self->notify = (LV2_Atom_Sequence*)data;
 			break;
+		case SPR_FFTSIZE:
+			self->p_fftsize = (float const*)data;
+			break;
+		case SPR_WEIGHT:
+			self->p_weight = (float const*)data;
+			break;
+		case SPR_WINDOW:
+			self->p_window = (float const*)data;
+			break;
 		default:
-			if (port > SPR_WINDOW && port <= SPR_WINDOW + 2 * MAX_CHANNELS) {
-				int chn = (port - SPR_WINDOW - 1) / 2;
+			if (port >= SPR_INPUT0 && port < SPR_INPUT0 + 2 * self->n_channels) {
+				int chn = (port - SPR_INPUT0) / 2;
 				if (port & 1) {
 					self->input[chn] = (float const*)data;
 				} else {
 					self->output[chn] = (float*)data;
 				}
+			} else if (port >= SPR_INPUT0 + 2 * self->n_channels && port < SPR_INPUT0 + 2 * self->n_channels + SPR_N_DESC) {
+				self->p_desc[port - SPR_INPUT0 - 2 * self->n_channels] = (float*)data;
 			}
 			break;
 	}
@@ -135,7 +307,7 @@ connect_port (LV2_Handle handle,
 /** forge atom-vector of raw data */
 static void
 tx_rawaudio (LV2_Atom_Forge* forge, SpectraLV2URIs* uris,
-             const int32_t channel, const size_t n_samples, void const* data)
+             const int32_t channel, const int64_t pos, const size_t n_samples, void const* data)
 {
 	LV2_Atom_Forge_Frame frame;
 	/* forge container object of type 'rawaudio' */
@@ -146,6 +318,10 @@ tx_rawaudio (LV2_Atom_Forge* forge, SpectraLV2URIs* uris,
 	lv2_atom_forge_property_head (forge, uris->channelid, 0);
 	lv2_atom_forge_int (forge, channel);
 
+	/* position of the first sample in the raw audio stream */
+	lv2_atom_forge_property_head (forge, uris->framepos, 0);
+	lv2_atom_forge_long (forge, pos);
+
 	/* add vector of floats raw 'audiodata' */
 	lv2_atom_forge_property_head (forge, uris->audiodata, 0);
 	lv2_atom_forge_vector (forge, sizeof (float), uris->atom_Float, n_samples, data);
@@ -154,30 +330,404 @@ tx_rawaudio (LV2_Atom_Forge* forge, SpectraLV2URIs* uris,
 	lv2_atom_forge_pop (forge, &frame);
 }
 
+/** forge atom-vector of the tone monitor's levels */
+static void
+tx_tones (LV2_Atom_Forge* forge, SpectraLV2URIs* uris, SpectraTones const* t)
+{
+	LV2_Atom_Forge_Frame frame;
+	lv2_atom_forge_frame_time (forge, 0);
+	x_forge_object (forge, &frame, 1, uris->tonelevel);
+
+	lv2_atom_forge_property_head (forge, uris->tonefreq, 0);
+	lv2_atom_forge_vector (forge, sizeof (float), uris->atom_Float, t->n_tones, t->freq);
+
+	lv2_atom_forge_property_head (forge, uris->tonedb, 0);
+	lv2_atom_forge_vector (forge, sizeof (float), uris->atom_Float, t->n_tones, t->level);
+
+	lv2_atom_forge_pop (forge, &frame);
+}
+
+/** forge atom-vector of display-resolution power spectrum */
+static void
+tx_spectrum (LV2_Atom_Forge* forge, SpectraLV2URIs* uris,
+             const int32_t channel, const size_t n_points, float const* data)
+{
+	LV2_Atom_Forge_Frame frame;
+	lv2_atom_forge_frame_time (forge, 0);
+	x_forge_object (forge, &frame, 1, uris->spectrum);
+
+	lv2_atom_forge_property_head (forge, uris->channelid, 0);
+	lv2_atom_forge_int (forge, channel);
+
+	lv2_atom_forge_property_head (forge, uris->bandpower, 0);
+	lv2_atom_forge_vector (forge, sizeof (float), uris->atom_Float, n_points, data);
+
+	lv2_atom_forge_pop (forge, &frame);
+}
+
+/******************************************************************************
+ * DSP-side analysis (worker thread)
+ */
+
+static bool
+dsp_reinit_fft (Spectra* self, uint32_t fft_size)
+{
+	fftx_free (self->fa);
+	self->fa = (struct FFTAnalysis*)malloc (sizeof (struct FFTAnalysis));
+	if (!self->fa) {
+		return false;
+	}
+	fftx_init (self->fa, fft_size, self->n_channels, self->rate, DSP_FPS);
+	fl_init (&self->fl, fft_size, self->rate);
+	free (self->band);
+	self->band    = (uint32_t*)malloc (fftx_bins (self->fa) * sizeof (uint32_t));
+	self->n_bands = 0;
+	if (!self->band) {
+		/* start over with the next work() call */
+		fftx_free (self->fa);
+		self->fa = NULL;
+		return false;
+	}
+	return true;
+}
+
+/** map FFT bins to display points, equally spaced on the log x-axis */
+static void
+dsp_map_bands (Spectra* self, uint32_t n_points)
+{
+	const uint32_t b = fftx_bins (self->fa);
+	for (uint32_t i = 0; i < b; ++i) {
+		const uint32_t k = floorf (ft_x_deflect_bin (&self->fl, i) * n_points);
+		self->band[i]    = MIN (k, n_points - 1);
+	}
+	self->n_bands = n_points;
+}
+
+/** mean power of all channels at bin i */
+static inline float
+dsp_power_at (Spectra* self, uint32_t i)
+{
+	float p = 0;
+	for (uint32_t c = 0; c < self->n_channels; ++c) {
+		p += fftx_power (self->fa, c)[i];
+	}
+	return p / self->n_channels;
+}
+
+/** spectral descriptors of the mean power of all channels, see SpectraDescriptor */
+static void
+dsp_descriptors (Spectra* self, float* desc)
+{
+	struct FFTAnalysis* fa  = self->fa;
+	const uint32_t      b   = fftx_bins (fa);
+	const double        fpb = fa->freq_per_bin;
+
+	/* RMS band 20Hz .. 20kHz */
+	const uint32_t b_lo = MAX (1, ceil (20. / fpb));
+	const uint32_t b_hi = MIN (b - 1, floor (20000. / fpb) + 1);
+
+	double   sum  = 0;
+	double   wsum = 0;
+	double   lsum = 0;
+	double   bsum = 0;
+	float    pmax = 0;
+	uint32_t imax = 0;
+
+	/* the last bin (nyquist) is not computed, see ft_power() */
+	for (uint32_t i = 1; i < b - 1; ++i) {
+		const float p = dsp_power_at (self, i);
+		sum += p;
+		wsum += (double)p * i;
+		lsum += log (p + 1e-20);
+		if (i >= b_lo && i < b_hi) {
+			bsum += p;
+		}
+		if (p > pmax) {
+			pmax = p;
+			imax = i;
+		}
+	}
+
+	if (sum <= 0) {
+		desc[SPR_DESC_CENTROID] = 0;
+		desc[SPR_DESC_FLATNESS] = 0;
+		desc[SPR_DESC_ROLLOFF]  = 0;
+		desc[SPR_DESC_PEAK]     = 0;
+		desc[SPR_DESC_RMS]      = -120;
+		return;
+	}
+
+	desc[SPR_DESC_CENTROID] = fpb * wsum / sum;
+	desc[SPR_DESC_FLATNESS] = MIN (1.0, exp (lsum / (b - 2)) / (sum / (b - 2)));
+
+	double   acc = 0;
+	uint32_t i   = 1;
+	for (; i < b - 2; ++i) {
+		acc += dsp_power_at (self, i);
+		if (acc >= .85 * sum) {
+			break;
+		}
+	}
+	desc[SPR_DESC_ROLLOFF] = fpb * i;
+
+	/* parabolic interpolation of the peak, on a log scale */
+	double ip = imax;
+	if (imax > 1 && imax < b - 2) {
+		const double l = log (dsp_power_at (self, imax - 1) + 1e-20);
+		const double c = log (pmax + 1e-20);
+		const double r = log (dsp_power_at (self, imax + 1) + 1e-20);
+		const double d = l - 2 * c + r;
+		if (d < 0) {
+			ip += .5 * (l - r) / d;
+		}
+	}
+	desc[SPR_DESC_PEAK] = fpb * ip;
+
+	/* Parseval: mean-square = 2 * sum (power) / (N * sum (window^2)) */
+	float const* w   = fa->window->data;
+	double       wsq = 0;
+	for (uint32_t k = 0; k < fa->window_size; ++k) {
+		wsq += w[k] * w[k];
+	}
+	const double ms    = 2. * bsum / (fa->window_size * wsq);
+	desc[SPR_DESC_RMS] = MAX (-120., 10. * log10 (ms + 1e-20));
+}
+
+static LV2_Worker_Status
+work (LV2_Handle                  instance,
+      LV2_Worker_Respond_Function respond,
+      LV2_Worker_Respond_Handle   handle,
+      uint32_t                    size,
+      const void*                 data)
+{
+	Spectra* self = (Spectra*)instance;
+	if (size != sizeof (SpectraWork)) {
+		return LV2_WORKER_ERR_UNKNOWN;
+	}
+	const SpectraWork* w = (const SpectraWork*)data;
+
+	SpectraWorkResponse r;
+	r.n_points = 0;
+	r.analyzed = false;
+
+	if (!self->fa || self->fa->window_size != w->fft_size) {
+		if (!dsp_reinit_fft (self, w->fft_size)) {
+			respond (handle, sizeof (SpectraWorkResponse), &r);
+			return LV2_WORKER_ERR_UNKNOWN;
+		}
+	}
+	if (w->n_points > 0 && self->n_bands != w->n_points) {
+		dsp_map_bands (self, w->n_points);
+	}
+
+	uint32_t n_avail = spr_ring_read_space (self->ring[0]);
+	for (uint32_t c = 1; c < self->n_channels; ++c) {
+		n_avail = MIN (n_avail, spr_ring_read_space (self->ring[c]));
+	}
+
+	fftx_set_window (self->fa, w->window);
+	fftx_set_overlap (self->fa, w->overlap);
+	fftx_set_averaging (self->fa, SPR_AVG_MODE (w->averaging), SPR_AVG_N (w->averaging));
+
+	float const* d[MAX_CHANNELS];
+	bool         analyzed = false;
+	uint32_t     remain   = n_avail;
+
+	while (remain > 0) {
+		const uint32_t n = MIN (remain, DSP_WBUFSIZE);
+		for (uint32_t c = 0; c < self->n_channels; ++c) {
+			spr_ring_read (self->ring[c], self->wbuf[c], n);
+			d[c] = self->wbuf[c];
+		}
+		if (!fftx_run (self->fa, n, d)) {
+			analyzed = true;
+		}
+		remain -= n;
+	}
+
+	if (analyzed) {
+		dsp_descriptors (self, r.desc);
+		r.analyzed = true;
+	}
+
+	if (analyzed && w->n_points > 0) {
+		const uint32_t b = fftx_bins (self->fa);
+		for (uint32_t t = 0; t < self->n_traces; ++t) {
+			float const* power = fftx_power (self->fa, t);
+			float*       spec  = self->spec[t];
+			memset (spec, 0, w->n_points * sizeof (float));
+			for (uint32_t i = 1; i < b - 1; ++i) {
+				const float    ffpow = w->pink ? (power[i] * i * .5) : power[i];
+				const uint32_t k     = self->band[i];
+				if (ffpow > spec[k]) {
+					spec[k] = ffpow;
+				}
+			}
+		}
+		r.n_points = w->n_points;
+	}
+
+	respond (handle, sizeof (SpectraWorkResponse), &r);
+	return LV2_WORKER_SUCCESS;
+}
+
+static LV2_Worker_Status
+work_response (LV2_Handle  instance,
+               uint32_t    size,
+               const void* data)
+{
+	Spectra* self = (Spectra*)instance;
+	if (size == sizeof (SpectraWorkResponse)) {
+		const SpectraWorkResponse* r = (const SpectraWorkResponse*)data;
+		self->spec_points            = r->n_points;
+		if (r->analyzed) {
+			memcpy (self->desc, r->desc, sizeof (self->desc));
+		}
+	}
+	self->work_pending = false;
+	return LV2_WORKER_SUCCESS;
+}
+
+/******************************************************************************/
+
+/** forge atom-chunk of block floating point encoded raw data */
+static void
+tx_rawaudio_bfp (LV2_Atom_Forge* forge, SpectraLV2URIs* uris, int16_t* buf,
+                 const int32_t channel, const int64_t pos, const size_t n_samples, float const* data)
+{
+	LV2_Atom_Forge_Frame frame;
+	lv2_atom_forge_frame_time (forge, 0);
+	x_forge_object (forge, &frame, 1, uris->rawaudio);
+
+	lv2_atom_forge_property_head (forge, uris->channelid, 0);
+	lv2_atom_forge_int (forge, channel);
+
+	lv2_atom_forge_property_head (forge, uris->framepos, 0);
+	lv2_atom_forge_long (forge, pos);
+
+	/* encode in chunks directly into the forge */
+	const uint32_t n_bytes = bfp_size (n_samples);
+	lv2_atom_forge_property_head (forge, uris->audiobfp, 0);
+	lv2_atom_forge_atom (forge, n_bytes, uris->atom_Chunk);
+	for (uint32_t off = 0; off < n_samples; off += BFP_CHUNK) {
+		const uint32_t n = bfp_encode (buf, &data[off], MIN (BFP_CHUNK, n_samples - off));
+		lv2_atom_forge_raw (forge, buf, n * sizeof (int16_t));
+	}
+	lv2_atom_forge_pad (forge, n_bytes);
+
+	lv2_atom_forge_pop (forge, &frame);
+}
+
+/** size of raw audio messages, sent when adding n_samples */
+static size_t
+raw_size (Spectra* self, uint32_t n_samples)
+{
+	const uint32_t n_tx = (self->acc_n + n_samples) / self->acc_size;
+	if (self->encoding == SPR_ENC_RING) {
+		return n_tx > 0 ? 96 : 0;
+	}
+	const size_t   smps = self->encoding == SPR_ENC_BFP ? bfp_size (self->acc_size) : sizeof (float) * self->acc_size;
+	return n_tx * (smps + 104) * self->n_channels;
+}
+
+/** notify the UI that raw audio is available in the ringbuffer,
+ * along with the total number of samples dropped because it was full */
+static void
+tx_ringdata (LV2_Atom_Forge* forge, SpectraLV2URIs* uris, const int64_t dropped)
+{
+	LV2_Atom_Forge_Frame frame;
+	lv2_atom_forge_frame_time (forge, 0);
+	x_forge_object (forge, &frame, 1, uris->ringdata);
+	lv2_atom_forge_property_head (forge, uris->dropped, 0);
+	lv2_atom_forge_long (forge, dropped);
+	lv2_atom_forge_pop (forge, &frame);
+}
+
+/** send DSP statistics to the UI */
+static void
+tx_stats (LV2_Atom_Forge* forge, SpectraLV2URIs* uris, SpectraHist const* forged, uint64_t capacity)
+{
+	LV2_Atom_Forge_Frame frame;
+	lv2_atom_forge_frame_time (forge, 0);
+	x_forge_object (forge, &frame, 1, uris->dspstats);
+
+	lv2_atom_forge_property_head (forge, uris->forged, 0);
+	lv2_atom_forge_vector (forge, sizeof (uint64_t), uris->atom_Long, SPR_HIST_LEN, forged);
+
+	lv2_atom_forge_property_head (forge, uris->capdrops, 0);
+	lv2_atom_forge_long (forge, capacity);
+
+	lv2_atom_forge_pop (forge, &frame);
+}
+
+/** notify the UI that the input became silent, raw audio is suspended */
+static void
+tx_silence (LV2_Atom_Forge* forge, SpectraLV2URIs* uris)
+{
+	LV2_Atom_Forge_Frame frame;
+	lv2_atom_forge_frame_time (forge, 0);
+	x_forge_object (forge, &frame, 1, uris->silence);
+	lv2_atom_forge_pop (forge, &frame);
+}
+
+/** send collected raw audio of all channels to the UI */
+static void
+tx_accumulated (Spectra* self)
+{
+	const int64_t pos = self->raw_pos - self->acc_n;
+	for (uint32_t c = 0; c < self->n_channels; ++c) {
+		if (self->encoding == SPR_ENC_BFP) {
+			tx_rawaudio_bfp (&self->forge, &self->uris, self->bfp_buf, c, pos, self->acc_n, self->acc[c]);
+		} else {
+			tx_rawaudio (&self->forge, &self->uris, c, pos, self->acc_n, self->acc[c]);
+		}
+	}
+	self->acc_n = 0;
+}
+
 static void
 run (LV2_Handle handle, uint32_t n_samples)
 {
 	Spectra*       self     = (Spectra*)handle;
-	const size_t   size     = (sizeof (float) * n_samples + 64) * self->n_channels;
+	const bool     dsp_fft  = self->ui_active && self->dsp_points > 0 && self->schedule;
 	const uint32_t capacity = self->notify->atom.size;
 
+	const bool     raw_tx   = self->ui_active && !dsp_fft;
+
+	if (raw_tx && self->acc_n > 0 && capacity < raw_size (self, n_samples) + UI_STATE_SIZE + self->n_channels * 32) {
+		/* large period, discard collected audio rather than the current cycle */
+		self->acc_n = 0;
+	}
+
+	/* statistics are due once per second while the UI is active */
+	if (self->ui_active && self->st_time < self->rate) {
+		self->st_time += n_samples;
+	}
+
+	const size_t size = (dsp_fft ? (sizeof (float) * MAX_DSP_POINTS + 64) * self->n_traces : 0)
+	                    + (raw_tx ? raw_size (self, n_samples) : 0)
+	                    + (self->tones.n_tones > 0 ? 2 * sizeof (float) * MAX_TONES + 96 : 0);
+
 	/* check if atom-port buffer is large enough to hold
-   * all audio-samples and configuration settings */
-	if (capacity < size + 160 + self->n_channels * 32) {
-		if (!printed_capacity_warning) {
-			fprintf (stderr, "Spectra.lv2 error: LV2 comm-buffersize is insufficient %d/%ld bytes.\n",
-			         capacity, size + 160 + self->n_channels * 32);
-			printed_capacity_warning = true;
-		}
-		return;
+	 * all audio-samples and configuration settings.
+	 * If not, no messages are sent this cycle, but control events
+	 * are processed and audio is still forwarded.
+	 * (no printing here, skipped cycles are reported to the UI) */
+	const bool tx = capacity >= size + UI_STATE_SIZE + self->n_channels * 32;
+	if (!tx) {
+		++self->st_capacity;
 	}
 
+	/* statistics are optional, only sent when there is space left */
+	const bool stats = tx && self->ui_active && self->st_time >= self->rate
+	                   && capacity >= size + STATS_SIZE + UI_STATE_SIZE + self->n_channels * 32;
+
 	/* prepare forge buffer and initialize atom-sequence */
 	lv2_atom_forge_set_buffer (&self->forge, (uint8_t*)self->notify, capacity);
 	lv2_atom_forge_sequence_head (&self->forge, &self->frame, 0);
 
 	/* Send settings to UI */
-	if (self->send_settings_to_ui && self->ui_active) {
+	if (self->send_settings_to_ui && self->ui_active && tx) {
 		self->send_settings_to_ui = false;
 		/* forge container object of type 'ui_state' */
 		LV2_Atom_Forge_Frame frame;
@@ -186,6 +736,26 @@ run (LV2_Handle handle, uint32_t n_samples)
 		/* forge attributes for 'ui_state' */
 		lv2_atom_forge_property_head (&self->forge, self->uris.samplerate, 0);
 		lv2_atom_forge_float (&self->forge, self->rate);
+		lv2_atom_forge_property_head (&self->forge, self->uris.dspfft, 0);
+		lv2_atom_forge_int (&self->forge, self->schedule ? self->dsp_points : -1);
+		lv2_atom_forge_property_head (&self->forge, self->uris.traces, 0);
+		lv2_atom_forge_int (&self->forge, self->trace_mask);
+		lv2_atom_forge_property_head (&self->forge, self->uris.overlap, 0);
+		lv2_atom_forge_int (&self->forge, self->overlap);
+		lv2_atom_forge_property_head (&self->forge, self->uris.averaging, 0);
+		lv2_atom_forge_int (&self->forge, self->averaging);
+		lv2_atom_forge_property_head (&self->forge, self->uris.multires, 0);
+		lv2_atom_forge_int (&self->forge, self->multires);
+		lv2_atom_forge_property_head (&self->forge, self->uris.zoom, 0);
+		lv2_atom_forge_int (&self->forge, self->zoom);
+		lv2_atom_forge_property_head (&self->forge, self->uris.zoomfreq, 0);
+		lv2_atom_forge_float (&self->forge, self->zoom_freq);
+		lv2_atom_forge_property_head (&self->forge, self->uris.smoothing, 0);
+		lv2_atom_forge_int (&self->forge, self->smoothing);
+		lv2_atom_forge_property_head (&self->forge, self->uris.peak, 0);
+		lv2_atom_forge_int (&self->forge, self->peak);
+		lv2_atom_forge_property_head (&self->forge, self->uris.waterfall, 0);
+		lv2_atom_forge_int (&self->forge, self->waterfall);
 
 		/* close-off frame */
 		lv2_atom_forge_pop (&self->forge, &frame);
@@ -211,39 +781,267 @@ run (LV2_Handle handle, uint32_t n_samples)
 				/* interpret atom-objects: */
 				if (obj->body.otype == self->uris.ui_on) {
 					/* UI was activated */
+					const LV2_Atom* a0        = NULL;
 					self->ui_active           = true;
 					self->send_settings_to_ui = true;
+					self->encoding            = SPR_ENC_FLOAT;
+					self->acc_n               = 0;
+					spr_silence_reset (&self->silence);
+					/* check for compact encoding supported by the UI */
+					if (1 == lv2_atom_object_get (obj, self->uris.encoding, &a0, NULL) && a0 && a0->type == self->uris.atom_Int) {
+						switch (((LV2_Atom_Int*)a0)->body) {
+							case SPR_ENC_BFP:
+								self->encoding = SPR_ENC_BFP;
+								break;
+							case SPR_ENC_RING:
+								self->encoding = SPR_ENC_RING;
+								break;
+							default:
+								break;
+						}
+					}
+				} else if (obj->body.otype == self->uris.tones) {
+					/* configure the tone monitor, an empty list disables it */
+					const LV2_Atom* a0 = NULL;
+					const LV2_Atom* a1 = NULL;
+					lv2_atom_object_get (obj, self->uris.tonefreq, &a0, self->uris.tonetime, &a1, NULL);
+					if (a1 && a1->type == self->uris.atom_Float) {
+						self->tone_time = MIN (10.f, MAX (.01f, ((LV2_Atom_Float*)a1)->body));
+					}
+					if (a0 && a0->type == self->uris.atom_Vector) {
+						const LV2_Atom_Vector* v = (const LV2_Atom_Vector*)a0;
+						if (v->body.child_type == self->uris.atom_Float && v->body.child_size == sizeof (float)) {
+							const uint32_t n = (a0->size - sizeof (LV2_Atom_Vector_Body)) / sizeof (float);
+							spr_tones_set (&self->tones, self->rate, (float const*)(v + 1), n, self->tone_time);
+						}
+					} else if (a1) {
+						spr_tones_set (&self->tones, self->rate, self->tones.freq, self->tones.n_tones, self->tone_time);
+					}
 				} else if (obj->body.otype == self->uris.ui_off) {
 					/* UI was closed */
 					self->ui_active = false;
+				} else if (obj->body.otype == self->uris.ui_state) {
+					/* UI settings */
+					const LV2_Atom* a0 = NULL;
+					const LV2_Atom* a1 = NULL;
+					const LV2_Atom* a2 = NULL;
+					const LV2_Atom* a3 = NULL;
+					const LV2_Atom* a4 = NULL;
+					const LV2_Atom* a5 = NULL;
+					const LV2_Atom* a6 = NULL;
+					const LV2_Atom* a7 = NULL;
+					const LV2_Atom* a8 = NULL;
+					const LV2_Atom* a9 = NULL;
+					lv2_atom_object_get (obj, self->uris.dspfft, &a0, self->uris.traces, &a1,
+					                     self->uris.overlap, &a2, self->uris.averaging, &a3,
+					                     self->uris.multires, &a4, self->uris.zoom, &a5,
+					                     self->uris.zoomfreq, &a6, self->uris.smoothing, &a7,
+					                     self->uris.peak, &a8, self->uris.waterfall, &a9, NULL);
+					if (a0 && a0->type == self->uris.atom_Int) {
+						const int32_t n  = ((LV2_Atom_Int*)a0)->body;
+						self->dsp_points = n < 0 ? 0 : MIN (n, MAX_DSP_POINTS);
+					}
+					if (a1 && a1->type == self->uris.atom_Int) {
+						self->trace_mask = ((LV2_Atom_Int*)a1)->body;
+					}
+					if (a2 && a2->type == self->uris.atom_Int) {
+						self->overlap = MAX (0, ((LV2_Atom_Int*)a2)->body);
+					}
+					if (a3 && a3->type == self->uris.atom_Int) {
+						self->averaging = ((LV2_Atom_Int*)a3)->body;
+					}
+					if (a4 && a4->type == self->uris.atom_Int) {
+						self->multires = ((LV2_Atom_Int*)a4)->body;
+					}
+					if (a5 && a5->type == self->uris.atom_Int) {
+						self->zoom = ((LV2_Atom_Int*)a5)->body;
+					}
+					if (a6 && a6->type == self->uris.atom_Float) {
+						self->zoom_freq = ((LV2_Atom_Float*)a6)->body;
+					}
+					if (a7 && a7->type == self->uris.atom_Int) {
+						self->smoothing = MAX (0, ((LV2_Atom_Int*)a7)->body);
+					}
+					if (a8 && a8->type == self->uris.atom_Int) {
+						self->peak = MAX (0, ((LV2_Atom_Int*)a8)->body);
+					}
+					if (a9 && a9->type == self->uris.atom_Int) {
+						self->waterfall = ((LV2_Atom_Int*)a9)->body;
+					}
+					/* retained only, the UI already knows; settings are sent on ui_on */
 				}
 			}
 			ev = lv2_atom_sequence_next (ev);
 		}
 	}
 
+	const bool analyze = self->ui_active && self->dsp_points > 0 && self->schedule;
+
+	if (analyze && self->spec_points > 0 && tx) {
+		/* send spectra of the most recent analysis */
+		for (uint32_t t = 0; t < self->n_traces; ++t) {
+			tx_spectrum (&self->forge, &self->uris, t, self->spec_points, self->spec[t]);
+		}
+	}
+	self->spec_points = 0;
+
+	/* the worker also computes the descriptor outputs, with or without UI */
+	if (self->schedule) {
+		for (uint32_t c = 0; c < self->n_channels; ++c) {
+			spr_ring_write (self->ring[c], self->input[c], n_samples);
+		}
+		if (!self->work_pending && spr_ring_read_space (self->ring[0]) >= self->hop) {
+			SpectraWork w;
+			w.fft_size  = (uint32_t)MIN (131072, MAX (1024, self->p_fftsize ? *self->p_fftsize : 4096)) & ~1;
+			w.n_points  = analyze ? self->dsp_points : 0;
+			w.window    = self->p_window ? (window_t)*self->p_window : W_HANN;
+			w.overlap   = self->overlap;
+			w.averaging = self->averaging;
+			w.pink      = self->p_weight && *self->p_weight > 0;
+			if (LV2_WORKER_SUCCESS == self->schedule->schedule_work (self->schedule->handle, sizeof (SpectraWork), &w)) {
+				self->work_pending = true;
+			}
+		}
+	}
+
+	/* suspend raw audio while the input is silent, the UI is notified once */
+	bool silent = false;
+	if (self->ui_active && !analyze && tx) {
+		if (spr_silence_run (&self->silence, self->input, self->n_channels, n_samples, self->rate * SILENCE_HOLD)) {
+			tx_silence (&self->forge, &self->uris);
+		}
+		silent = self->silence.silent;
+	} else if (self->ui_active && !analyze) {
+		silent = self->silence.silent;
+	} else {
+		spr_silence_reset (&self->silence);
+	}
+
+	/* if UI is active, collect raw audio data and send it to UI */
+	if (silent) {
+		if (self->encoding != SPR_ENC_RING) {
+			/* collected audio is not sent, nor is audio while silent.
+			 * Neither is part of the raw audio stream, the UI sees no gap */
+			self->raw_pos -= self->acc_n;
+		}
+		self->acc_n = 0;
+	} else if (self->ui_active && !analyze && !tx && self->encoding != SPR_ENC_RING) {
+		/* no space to send it, the UI will see a gap */
+		self->raw_pos += n_samples;
+		self->acc_n = 0;
+	} else if (self->ui_active && !analyze && self->encoding == SPR_ENC_RING) {
+		/* the UI reads the ringbuffer directly, only notify it.
+		 * All channels are written in lockstep, audio that does not fit is dropped */
+		uint32_t n = n_samples;
+		for (uint32_t c = 0; c < self->n_channels; ++c) {
+			n = MIN (n, spr_ring_write_space (self->uiring[c]));
+		}
+		for (uint32_t c = 0; c < self->n_channels; ++c) {
+			spr_ring_write (self->uiring[c], self->input[c], n);
+		}
+		self->raw_dropped += n_samples - n;
+		self->acc_n = MIN (self->acc_n + n_samples, self->acc_size);
+		if (self->acc_n >= self->acc_size && tx) {
+			tx_ringdata (&self->forge, &self->uris, self->raw_dropped);
+			self->acc_n = 0;
+		}
+	} else if (self->ui_active && !analyze) {
+		uint32_t off = 0;
+		while (off < n_samples) {
+			const uint32_t n = MIN (n_samples - off, self->acc_size - self->acc_n);
+			for (uint32_t c = 0; c < self->n_channels; ++c) {
+				memcpy (&self->acc[c][self->acc_n], &self->input[c][off], sizeof (float) * n);
+			}
+			self->acc_n += n;
+			self->raw_pos += n;
+			off += n;
+			if (self->acc_n >= self->acc_size) {
+				tx_accumulated (self);
+			}
+		}
+	} else {
+		self->acc_n = 0;
+	}
+
+	if (spr_tones_run (&self->tones, self->input, self->n_channels, n_samples) && tx) {
+		tx_tones (&self->forge, &self->uris, &self->tones);
+	}
+
 	/* process audio data */
 	for (uint32_t c = 0; c < self->n_channels; ++c) {
-		if (self->ui_active) {
-			/* if UI is active, send raw audio data to UI */
-			tx_rawaudio (&self->forge, &self->uris, c, n_samples, self->input[c]);
-		}
 		/* if not processing in-place, forward audio */
 		if (self->input[c] != self->output[c]) {
 			memcpy (self->output[c], self->input[c], sizeof (float) * n_samples);
 		}
 	}
 
+	for (uint32_t k = 0; k < SPR_N_DESC; ++k) {
+		if (self->p_desc[k]) {
+			*self->p_desc[k] = self->desc[k];
+		}
+	}
+
+	if (stats) {
+		tx_stats (&self->forge, &self->uris, &self->st_forged, self->st_capacity);
+		self->st_time = 0;
+	}
+
 	/* close off atom-sequence */
 	lv2_atom_forge_pop (&self->forge, &self->frame);
+
+	spr_hist_add (&self->st_forged, self->forge.offset);
 }
 
 static void
 cleanup (LV2_Handle handle)
 {
+	Spectra* self = (Spectra*)handle;
+	fftx_free (self->fa);
+	for (uint32_t c = 0; c < self->n_channels; ++c) {
+		spr_ring_free (self->uiring[c]);
+		spr_ring_free (self->ring[c]);
+		free (self->wbuf[c]);
+	}
+	free (self->band);
 	free (handle);
 }
 
+static uint32_t
+ring_read_space (void* instance)
+{
+	Spectra* self = (Spectra*)instance;
+	uint32_t n    = spr_ring_read_space (self->uiring[0]);
+	for (uint32_t c = 1; c < self->n_channels; ++c) {
+		n = MIN (n, spr_ring_read_space (self->uiring[c]));
+	}
+	return n;
+}
+
+static uint32_t
+ring_read (void* instance, float* const* data, uint32_t n)
+{
+	Spectra* self = (Spectra*)instance;
+	n             = MIN (n, ring_read_space (instance));
+	for (uint32_t c = 0; c < self->n_channels; ++c) {
+		spr_ring_read (self->uiring[c], data[c], n);
+	}
+	return n;
+}
+
+static const void*
+extension_data (const char* uri)
+{
+	static const LV2_Worker_Interface worker = { work, work_response, NULL };
+	static const SpectraRingInterface ringbuf = { ring_read_space, ring_read };
+	if (!strcmp (uri, LV2_WORKER__interface)) {
+		return &worker;
+	}
+	if (!strcmp (uri, SPR__ringbuf)) {
+		return &ringbuf;
+	}
+	return NULL;
+}
+
 /* clang-format off */
 #define mkdesc(ID, NAME)                         \
   static const LV2_Descriptor descriptor##ID = { \
@@ -254,7 +1052,7 @@ cleanup (LV2_Handle handle)
     run,                                         \
     NULL,                                        \
     cleanup,                                     \
-    NULL                                         \
+    extension_data                               \
   };
 /* clang-format on */
 
@@ -262,6 +1060,7 @@ mkdesc (0, "#Mono")
     mkdesc (1, "#Mono_gtk")
         mkdesc (2, "#Stereo")
             mkdesc (3, "#Stereo_gtk")
+                mkdesc (4, "#Quad")
 
                 LV2_SYMBOL_EXPORT
     const LV2_Descriptor* lv2_descriptor (uint32_t index)
@@ -275,6 +1074,8 @@ mkdesc (0, "#Mono")
 			return &descriptor2;
 		case 3:
 			return &descriptor3;
+		case 4:
+			return &descriptor4;
 		default:
 			return NULL;
 	}
@@ -0,0 +1,110 @@
+/* simple spectrum analyzer
+ *
+ * Copyright (C) 2013 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPR_STATS_H
+#define SPR_STATS_H
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/* histogram with log2 buckets, of durations [ns] or sizes [bytes].
+ *
+ * bins[k] counts values in [2^(k-1), 2^k), bins[0] zero.
+ * All members are uint64_t, so that it can be sent as atom:Vector of
+ * atom:Long. Writer and reader are not synchronized, statistics are
+ * for display only.
+ */
+#define SPR_HIST_BINS (32)
+
+typedef struct {
+	uint64_t n;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t bins[SPR_HIST_BINS];
+} SpectraHist;
+
+#define SPR_HIST_LEN (sizeof (SpectraHist) / sizeof (uint64_t))
+
+/** monotonic time in nanoseconds */
+static inline uint64_t
+spr_time_ns (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void
+spr_hist_add (SpectraHist* h, uint64_t v)
+{
+	uint32_t k = 0;
+	for (uint64_t x = v; x > 0 && k < SPR_HIST_BINS - 1; x >>= 1) {
+		++k;
+	}
+	++h->bins[k];
+	++h->n;
+	h->sum += v;
+	if (v > h->max) {
+		h->max = v;
+	}
+}
+
+/** add the time since t0 */
+static inline void
+spr_hist_time (SpectraHist* h, uint64_t t0)
+{
+	spr_hist_add (h, spr_time_ns () - t0);
+}
+
+static inline double
+spr_hist_mean (SpectraHist const* h)
+{
+	return h->n > 0 ? h->sum / (double)h->n : 0;
+}
+
+/** approximate percentile (0..1), upper bound of the bin */
+static inline uint64_t
+spr_hist_percentile (SpectraHist const* h, double p)
+{
+	const uint64_t lim = p * h->n;
+	uint64_t       n   = 0;
+	for (uint32_t k = 0; k < SPR_HIST_BINS; ++k) {
+		n += h->bins[k];
+		if (n > lim) {
+			const uint64_t v = k > 0 ? (1ULL << k) - 1 : 0;
+			return v < h->max ? v : h->max;
+		}
+	}
+	return h->max;
+}
+
+/** print as JSON object, without trailing newline */
+static inline void
+spr_hist_json (FILE* f, SpectraHist const* h)
+{
+	fprintf (f, "{\"n\": %" PRIu64 ", \"sum\": %" PRIu64 ", \"max\": %" PRIu64 ", \"bins\": [",
+	         h->n, h->sum, h->max);
+	for (uint32_t k = 0; k < SPR_HIST_BINS; ++k) {
+		fprintf (f, "%s%" PRIu64, k > 0 ? ", " : "", h->bins[k]);
+	}
+	fprintf (f, "]}");
+}
+
+#endif
@@ -0,0 +1,142 @@
+/* simple spectrum analyzer
+ *
+ * Copyright (C) 2013 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPR_TONES_H
+#define SPR_TONES_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* bank of Goertzel filters, measuring the level of a few given
+ * frequencies in the mean of all channels.
+ *
+ * Every block of `block` samples yields one measurement per frequency,
+ * the cost is O(n_tones) per sample. Frequencies need not be centered
+ * on a DFT bin; with a rectangular window, the bandwidth is
+ * about rate / block.
+ */
+#define MAX_TONES (32)
+
+/* samples mixed down at a time */
+#define SPR_TONES_CHUNK (256)
+
+typedef struct {
+	uint32_t n_tones;
+	uint32_t block; /* samples per measurement */
+	uint32_t count; /* samples of the current block */
+	float    freq[MAX_TONES];
+	float    level[MAX_TONES]; /* dBFS of the last complete block, 0: full-scale sine */
+	double   coeff[MAX_TONES];
+	double   s1[MAX_TONES];
+	double   s2[MAX_TONES];
+} SpectraTones;
+
+/** configure n frequencies, measured every block_sec seconds.
+ * frequencies outside 0 .. rate/2 are ignored */
+static inline void
+spr_tones_set (SpectraTones* t, double rate, float const* freq, uint32_t n, float block_sec)
+{
+	t->n_tones = 0;
+	t->count   = 0;
+	t->block   = block_sec * rate;
+	if (t->block < 64) {
+		t->block = 64;
+	}
+	for (uint32_t i = 0; i < n && t->n_tones < MAX_TONES; ++i) {
+		if (!(freq[i] > 0 && freq[i] < rate * .5)) {
+			continue;
+		}
+		const uint32_t k = t->n_tones++;
+		t->freq[k]       = freq[i];
+		t->coeff[k]      = 2. * cos (2. * M_PI * freq[i] / rate);
+		t->level[k]      = -120;
+		t->s1[k]         = 0;
+		t->s2[k]         = 0;
+	}
+}
+
+/** process n_samples of every channel,
+ * returns true if a block was completed and t->level updated */
+static inline bool
+spr_tones_run (SpectraTones* t, float const* const* data, uint32_t n_channels, uint32_t n_samples)
+{
+	if (t->n_tones == 0) {
+		return false;
+	}
+
+	bool     rv  = false;
+	uint32_t off = 0;
+	while (off < n_samples) {
+		uint32_t n = n_samples - off < t->block - t->count ? n_samples - off : t->block - t->count;
+		if (n > SPR_TONES_CHUNK) {
+			n = SPR_TONES_CHUNK;
+		}
+
+		/* mix down, once for all frequencies */
+		float x[SPR_TONES_CHUNK];
+		if (n_channels == 1) {
+			memcpy (x, &data[0][off], n * sizeof (float));
+		} else {
+			const float norm = 1.f / n_channels;
+			for (uint32_t i = 0; i < n; ++i) {
+				float v = 0;
+				for (uint32_t c = 0; c < n_channels; ++c) {
+					v += data[c][off + i];
+				}
+				x[i] = v * norm;
+			}
+		}
+
+		for (uint32_t k = 0; k < t->n_tones; ++k) {
+			const double c  = t->coeff[k];
+			double       s1 = t->s1[k];
+			double       s2 = t->s2[k];
+			for (uint32_t i = 0; i < n; ++i) {
+				const double s0 = x[i] + c * s1 - s2;
+				s2              = s1;
+				s1              = s0;
+			}
+			t->s1[k] = s1;
+			t->s2[k] = s2;
+		}
+
+		t->count += n;
+		off += n;
+
+		if (t->count >= t->block) {
+			/* amplitude = 2 |X| / N */
+			const double g = 2. / t->block;
+			for (uint32_t k = 0; k < t->n_tones; ++k) {
+				const double s1 = t->s1[k];
+				const double s2 = t->s2[k];
+				const double p  = s1 * s1 + s2 * s2 - t->coeff[k] * s1 * s2;
+				const double a  = g * sqrt (p > 0 ? p : 0);
+				t->level[k]     = a > 1e-6 ? 20. * log10 (a) : -120;
+				t->s1[k]        = 0;
+				t->s2[k]        = 0;
+			}
+			t->count = 0;
+			rv       = true;
+		}
+	}
+	return rv;
+}
+
+#endif
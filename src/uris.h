@@ -43,12 +43,41 @@ typedef struct {
 	LV2_URID atom_Vector;
 	LV2_URID atom_Float;
 	LV2_URID atom_Int;
+	LV2_URID atom_Long;
+	LV2_URID atom_Chunk;
 	LV2_URID atom_eventTransfer;
 	LV2_URID rawaudio;
 	LV2_URID channelid;
 	LV2_URID audiodata;
+	LV2_URID audiobfp;
+	LV2_URID encoding;
+	LV2_URID ringdata;
+	LV2_URID silence;
+	LV2_URID framepos;
+	LV2_URID dropped;
+	LV2_URID dspstats;
+	LV2_URID forged;
+	LV2_URID capdrops;
+
+	LV2_URID spectrum;
+	LV2_URID bandpower;
 
 	LV2_URID samplerate;
+	LV2_URID dspfft;
+	LV2_URID traces;
+	LV2_URID overlap;
+	LV2_URID averaging;
+	LV2_URID multires;
+	LV2_URID zoom;
+	LV2_URID zoomfreq;
+	LV2_URID smoothing;
+	LV2_URID peak;
+	LV2_URID waterfall;
+	LV2_URID tones;
+	LV2_URID tonefreq;
+	LV2_URID tonetime;
+	LV2_URID tonelevel;
+	LV2_URID tonedb;
 	LV2_URID ui_on;
 	LV2_URID ui_off;
 	LV2_URID ui_state;
@@ -62,11 +91,39 @@ map_spectra_uris (LV2_URID_Map* map, SpectraLV2URIs* uris)
 	uris->atom_Vector        = map->map (map->handle, LV2_ATOM__Vector);
 	uris->atom_Float         = map->map (map->handle, LV2_ATOM__Float);
 	uris->atom_Int           = map->map (map->handle, LV2_ATOM__Int);
+	uris->atom_Long          = map->map (map->handle, LV2_ATOM__Long);
+	uris->atom_Chunk         = map->map (map->handle, LV2_ATOM__Chunk);
 	uris->atom_eventTransfer = map->map (map->handle, LV2_ATOM__eventTransfer);
 	uris->rawaudio           = map->map (map->handle, SPR_URI "#rawaudio");
 	uris->audiodata          = map->map (map->handle, SPR_URI "#audiodata");
+	uris->audiobfp           = map->map (map->handle, SPR_URI "#audiobfp");
+	uris->encoding           = map->map (map->handle, SPR_URI "#encoding");
+	uris->ringdata           = map->map (map->handle, SPR_URI "#ringdata");
+	uris->silence            = map->map (map->handle, SPR_URI "#silence");
+	uris->framepos           = map->map (map->handle, SPR_URI "#framepos");
+	uris->dropped            = map->map (map->handle, SPR_URI "#dropped");
+	uris->dspstats           = map->map (map->handle, SPR_URI "#dspstats");
+	uris->forged             = map->map (map->handle, SPR_URI "#forged");
+	uris->capdrops           = map->map (map->handle, SPR_URI "#capdrops");
 	uris->channelid          = map->map (map->handle, SPR_URI "#channelid");
+	uris->spectrum           = map->map (map->handle, SPR_URI "#spectrum");
+	uris->bandpower          = map->map (map->handle, SPR_URI "#bandpower");
 	uris->samplerate         = map->map (map->handle, SPR_URI "#samplerate");
+	uris->dspfft             = map->map (map->handle, SPR_URI "#dspfft");
+	uris->traces             = map->map (map->handle, SPR_URI "#traces");
+	uris->overlap            = map->map (map->handle, SPR_URI "#overlap");
+	uris->averaging          = map->map (map->handle, SPR_URI "#averaging");
+	uris->multires           = map->map (map->handle, SPR_URI "#multires");
+	uris->zoom               = map->map (map->handle, SPR_URI "#zoom");
+	uris->zoomfreq           = map->map (map->handle, SPR_URI "#zoomfreq");
+	uris->smoothing          = map->map (map->handle, SPR_URI "#smoothing");
+	uris->peak               = map->map (map->handle, SPR_URI "#peak");
+	uris->waterfall          = map->map (map->handle, SPR_URI "#waterfall");
+	uris->tones              = map->map (map->handle, SPR_URI "#tones");
+	uris->tonefreq           = map->map (map->handle, SPR_URI "#tonefreq");
+	uris->tonetime           = map->map (map->handle, SPR_URI "#tonetime");
+	uris->tonelevel          = map->map (map->handle, SPR_URI "#tonelevel");
+	uris->tonedb             = map->map (map->handle, SPR_URI "#tonedb");
 	uris->ui_on              = map->map (map->handle, SPR_URI "#ui_on");
 	uris->ui_off             = map->map (map->handle, SPR_URI "#ui_off");
 	uris->ui_state           = map->map (map->handle, SPR_URI "#ui_state");
@@ -82,6 +139,51 @@ typedef enum {
 	SPR_OUTPUT0 = 6,
 } PortIndex;
 
-#define MAX_CHANNELS (1)
+/* control outputs, following the audio ports of every variant,
+ * at SPR_INPUT0 + 2 * n_channels + SpectraDescriptor */
+typedef enum {
+	SPR_DESC_CENTROID = 0,
+	SPR_DESC_FLATNESS,
+	SPR_DESC_ROLLOFF,
+	SPR_DESC_PEAK,
+	SPR_DESC_RMS,
+	SPR_N_DESC
+} SpectraDescriptor;
+
+/* raw audio encoding, announced by the UI with ui_on */
+typedef enum {
+	SPR_ENC_FLOAT = 0, /* atom:Vector of atom:Float */
+	SPR_ENC_BFP   = 1, /* atom:Chunk, see bfp.h */
+	SPR_ENC_RING  = 2, /* shared ringbuffer, see SpectraRingInterface */
+} SpectraEncoding;
+
+/* extension_data() of the DSP, for UIs with instance- and data-access.
+ *
+ * Raw audio is written to a lock-free ringbuffer in the plugin instance,
+ * the DSP only sends an empty 'ringdata' object once per UI frame and
+ * the UI reads the audio directly. This bypasses the host's
+ * atom-ringbuffer.
+ */
+#define SPR__ringbuf SPR_URI "#ringbuf"
+
+typedef struct {
+	/** number of samples available for every channel */
+	uint32_t (*read_space) (void* instance);
+	/** read n samples of every channel, returns the number of samples read */
+	uint32_t (*read) (void* instance, float* const* data, uint32_t n);
+} SpectraRingInterface;
+
+/* ui_state 'averaging' value: (avg_t << 8) | number of frames */
+#define SPR_AVG(MODE, N) (((MODE) << 8) | (N))
+#define SPR_AVG_MODE(V) ((avg_t) (((V) >> 8) & 0xff))
+#define SPR_AVG_N(V) ((uint32_t) ((V) & 0xff))
+
+#define MAX_CHANNELS (4)
+
+/* traces per analysis: one per channel, stereo adds mid and side */
+#define MAX_TRACES (4)
+
+/* max number of display points per spectrum sent by the DSP */
+#define MAX_DSP_POINTS (1024)
 
 #endif
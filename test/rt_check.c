@@ -0,0 +1,919 @@
+/* simple spectrum analyzer -- DSP check
+ *
+ * Copyright (C) 2013 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* A minimal LV2 host for the DSP, see `make check`.
+ *
+ * Every plugin variant is instantiated via lv2_descriptor(), its ports are
+ * connected and run() is called with block sizes 1 .. 8192 and notify buffers
+ * of various sizes: with the UI closed, open for every raw audio encoding,
+ * with DSP-side analysis and with the tone monitor.
+ *
+ *  - malloc, free and mutex locks are interposed, any call during run()
+ *    or work_response() is an error.
+ *  - audio must be forwarded, the notify sequence must be valid.
+ *  - raw audio sent to the UI, or read from the DSP's ringbuffer, must match
+ *    the input at its stream position. If the notify buffer fits a cycle's
+ *    raw audio, none may be missing.
+ *  - spectra and tone levels must be well-formed.
+ *  - latency of run() is reported per block size. It depends on the machine
+ *    and its load, and is not checked.
+ *
+ * FFTW wisdom is written to a temporary directory, which is removed on exit.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_LV2_1_18_6
+#include <lv2/core/lv2.h>
+#include <lv2/worker/worker.h>
+#else
+#include <lv2/lv2plug.in/ns/ext/worker/worker.h>
+#include <lv2/lv2plug.in/ns/lv2core/lv2.h>
+#endif
+
+#include "../src/bfp.h"
+#include "../src/stats.h"
+#include "../src/uris.h"
+
+/* the plugin, linked in */
+extern const LV2_Descriptor* lv2_descriptor (uint32_t index);
+
+#define RATE (48000)
+#define MAX_BLOCK (8192)
+#define MAX_CHN (4)
+#define N_TIMED (32)
+
+/******************************************************************************
+ * interposed functions, counting calls from the realtime context
+ */
+
+static volatile bool in_rt      = false;
+static uint64_t      rt_calls   = 0;
+static const char*   rt_culprit = NULL;
+
+static void* (*real_malloc) (size_t);
+static void* (*real_calloc) (size_t, size_t);
+static void* (*real_realloc) (void*, size_t);
+static void (*real_free) (void*);
+static int (*real_mutex_lock) (pthread_mutex_t*);
+
+/* dlsym () may allocate, serve that from a static pool */
+static char   pool[8192];
+static size_t pool_used = 0;
+
+static void*
+pool_alloc (size_t n)
+{
+	n = (n + 15) & ~(size_t)15;
+	if (pool_used + n > sizeof (pool)) {
+		return NULL;
+	}
+	void* p = &pool[pool_used];
+	pool_used += n;
+	return p;
+}
+
+static bool
+in_pool (void* p)
+{
+	return (char*)p >= pool && (char*)p < pool + sizeof (pool);
+}
+
+/* also interpose calls from shared libraries, despite -fvisibility=hidden */
+#define RT_EXPORT __attribute__ ((visibility ("default")))
+
+static void
+rt_note (const char* fn)
+{
+	if (in_rt) {
+		++rt_calls;
+		rt_culprit = fn;
+	}
+}
+
+RT_EXPORT void*
+malloc (size_t n)
+{
+	if (!real_malloc) {
+		real_malloc = (void* (*)(size_t))dlsym (RTLD_NEXT, "malloc");
+		if (!real_malloc) {
+			return pool_alloc (n);
+		}
+	}
+	rt_note ("malloc");
+	return real_malloc (n);
+}
+
+RT_EXPORT void*
+calloc (size_t n, size_t s)
+{
+	static bool resolving = false;
+	if (!real_calloc) {
+		if (resolving) {
+			return pool_alloc (n * s); /* static, zero-initialized */
+		}
+		resolving   = true;
+		real_calloc = (void* (*)(size_t, size_t))dlsym (RTLD_NEXT, "calloc");
+		resolving   = false;
+	}
+	rt_note ("calloc");
+	return real_calloc (n, s);
+}
+
+RT_EXPORT void*
+realloc (void* p, size_t n)
+{
+	if (!real_realloc) {
+		real_realloc = (void* (*)(void*, size_t))dlsym (RTLD_NEXT, "realloc");
+	}
+	rt_note ("realloc");
+	return real_realloc (p, n);
+}
+
+RT_EXPORT void
+free (void* p)
+{
+	if (!p || in_pool (p)) {
+		return;
+	}
+	if (!real_free) {
+		real_free = (void (*) (void*))dlsym (RTLD_NEXT, "free");
+	}
+	rt_note ("free");
+	real_free (p);
+}
+
+RT_EXPORT int
+pthread_mutex_lock (pthread_mutex_t* m)
+{
+	if (!real_mutex_lock) {
+		real_mutex_lock = (int (*) (pthread_mutex_t*))dlsym (RTLD_NEXT, "pthread_mutex_lock");
+	}
+	rt_note ("pthread_mutex_lock");
+	return real_mutex_lock (m);
+}
+
+/******************************************************************************
+ * host
+ */
+
+static char*    urimap[256];
+static uint32_t n_urids = 0;
+
+static LV2_URID
+uri_to_id (LV2_URID_Map_Handle handle, const char* uri)
+{
+	for (uint32_t i = 0; i < n_urids; ++i) {
+		if (!strcmp (urimap[i], uri)) {
+			return i + 1;
+		}
+	}
+	if (n_urids >= sizeof (urimap) / sizeof (char*)) {
+		return 0;
+	}
+	urimap[n_urids] = strdup (uri);
+	return ++n_urids;
+}
+
+static LV2_URID_Map   map = { NULL, uri_to_id };
+static SpectraLV2URIs uris;
+static LV2_URID       atom_Sequence;
+
+/* the worker runs synchronously, after run() */
+static uint8_t  work_msg[1024];
+static uint32_t work_size    = 0;
+static uint8_t  resp_msg[1024];
+static uint32_t resp_size    = 0;
+static bool     work_pending = false;
+
+static LV2_Worker_Status
+schedule_work (LV2_Worker_Schedule_Handle handle, uint32_t size, const void* data)
+{
+	if (work_pending || size > sizeof (work_msg)) {
+		return LV2_WORKER_ERR_NO_SPACE;
+	}
+	memcpy (work_msg, data, size);
+	work_size    = size;
+	work_pending = true;
+	return LV2_WORKER_SUCCESS;
+}
+
+static LV2_Worker_Status
+work_respond (LV2_Worker_Respond_Handle handle, uint32_t size, const void* data)
+{
+	if (size > sizeof (resp_msg)) {
+		return LV2_WORKER_ERR_NO_SPACE;
+	}
+	memcpy (resp_msg, data, size);
+	resp_size = size;
+	return LV2_WORKER_SUCCESS;
+}
+
+static LV2_Worker_Schedule sched = { NULL, schedule_work };
+
+typedef struct {
+	const LV2_Descriptor*       desc;
+	LV2_Handle                  instance;
+	const LV2_Worker_Interface* worker;
+	const SpectraRingInterface* ring;
+	uint32_t                    n_channels;
+	uint32_t                    n_traces;
+
+	uint8_t        control[1024];
+	uint8_t*       notify;
+	float          p_fftsize;
+	float          p_weight;
+	float          p_window;
+	float          desc_out[16];
+	float          in[MAX_CHN][MAX_BLOCK];
+	float          out[MAX_CHN][MAX_BLOCK];
+	LV2_Atom_Forge       forge;
+	LV2_Atom_Forge_Frame ctrl; /* control sequence of the next cycle */
+
+	int64_t  pos;               /* stream position of the next cycle */
+	bool     ui_active;
+	bool     dspfft;            /* analysis in the DSP, no raw audio */
+	int64_t  raw_pos;           /* raw audio position, advances while it is sent */
+	int64_t  raw_offset;        /* pos - raw_pos of the current cycle */
+	int64_t  next[MAX_CHN];     /* expected position of raw audio */
+	uint64_t received[MAX_CHN]; /* samples of raw audio */
+	int64_t  ring_pos;          /* stream position of the next sample in the ringbuffer */
+	int64_t  ring_dropped;      /* most recent count of the DSP */
+	uint64_t ring_read;         /* samples read from the ringbuffer */
+	uint64_t n_stats;           /* received statistics reports */
+	uint64_t n_spectra;         /* received spectra, DSP-side analysis */
+	uint64_t n_tones;           /* received tone levels */
+	uint32_t encoding;
+} Host;
+
+static uint32_t n_errors = 0;
+
+static void
+fail (const char* fmt, ...)
+{
+	if (++n_errors > 30) {
+		return;
+	}
+	va_list ap;
+	va_start (ap, fmt);
+	printf ("  FAIL: ");
+	vprintf (fmt, ap);
+	printf ("\n");
+	va_end (ap);
+}
+
+/* test signal, non-silent and distinct per channel. It is tabulated,
+ * so that the input and the check use identical values */
+#define SIG_PERIOD (4800)
+static float sig_table[MAX_CHN][SIG_PERIOD];
+
+static void
+signal_init (void)
+{
+	for (uint32_t c = 0; c < MAX_CHN; ++c) {
+		for (uint32_t i = 0; i < SIG_PERIOD; ++i) {
+			sig_table[c][i] = .25 * sin (2. * M_PI * i * (c + 1) / SIG_PERIOD) + (c ? -.1 : .1);
+		}
+	}
+}
+
+static float
+signal_at (uint32_t c, int64_t pos)
+{
+	return sig_table[c][pos % SIG_PERIOD];
+}
+
+static uint32_t
+uri_channels (const char* uri)
+{
+	if (strstr (uri, "#Quad")) {
+		return 4;
+	} else if (strstr (uri, "#Stereo")) {
+		return 2;
+	}
+	return 1;
+}
+
+static void
+host_clear_control (Host* h)
+{
+	lv2_atom_forge_set_buffer (&h->forge, h->control, sizeof (h->control));
+	lv2_atom_forge_sequence_head (&h->forge, &h->ctrl, 0);
+}
+
+static bool
+host_init (Host* h, const char* uri)
+{
+	memset (h, 0, sizeof (Host));
+	for (uint32_t i = 0; (h->desc = lv2_descriptor (i)); ++i) {
+		if (!strcmp (h->desc->URI, uri)) {
+			break;
+		}
+	}
+	if (!h->desc) {
+		printf ("  FAIL: no descriptor for %s\n", uri);
+		return false;
+	}
+
+	LV2_Feature f_map   = { LV2_URID__map, &map };
+	LV2_Feature f_sched = { LV2_WORKER__schedule, &sched };
+
+	const LV2_Feature* features[] = { &f_map, &f_sched, NULL };
+
+	h->instance = h->desc->instantiate (h->desc, RATE, ".", features);
+	if (!h->instance) {
+		printf ("  FAIL: instantiate %s\n", uri);
+		return false;
+	}
+	h->worker     = (const LV2_Worker_Interface*)h->desc->extension_data (LV2_WORKER__interface);
+	h->ring       = (const SpectraRingInterface*)h->desc->extension_data (SPR__ringbuf);
+	h->n_channels = uri_channels (uri);
+	h->n_traces   = h->n_channels == 2 ? 4 : h->n_channels;
+	h->notify     = (uint8_t*)malloc (1 << 20);
+	h->p_fftsize  = 4096;
+
+	h->desc->connect_port (h->instance, SPR_CONTROL, h->control);
+	h->desc->connect_port (h->instance, SPR_NOTIFY, h->notify);
+	h->desc->connect_port (h->instance, SPR_FFTSIZE, &h->p_fftsize);
+	h->desc->connect_port (h->instance, SPR_WEIGHT, &h->p_weight);
+	h->desc->connect_port (h->instance, SPR_WINDOW, &h->p_window);
+	for (uint32_t c = 0; c < h->n_channels; ++c) {
+		h->desc->connect_port (h->instance, SPR_INPUT0 + 2 * c, h->in[c]);
+		h->desc->connect_port (h->instance, SPR_OUTPUT0 + 2 * c, h->out[c]);
+	}
+	for (uint32_t k = 0; k < SPR_N_DESC; ++k) {
+		h->desc->connect_port (h->instance, SPR_INPUT0 + 2 * h->n_channels + k, &h->desc_out[k]);
+	}
+	if (h->desc->activate) {
+		h->desc->activate (h->instance);
+	}
+
+	lv2_atom_forge_init (&h->forge, &map);
+	host_clear_control (h);
+	return true;
+}
+
+static void
+host_cleanup (Host* h)
+{
+	if (h->instance) {
+		h->desc->cleanup (h->instance);
+	}
+	free (h->notify);
+}
+
+/** queue a message for the next cycle, ui_on with the given encoding or ui_off */
+static void
+host_ui (Host* h, bool on, uint32_t encoding)
+{
+	LV2_Atom_Forge_Frame frame;
+	lv2_atom_forge_frame_time (&h->forge, 0);
+	x_forge_object (&h->forge, &frame, 1, on ? uris.ui_on : uris.ui_off);
+	if (on) {
+		lv2_atom_forge_property_head (&h->forge, uris.encoding, 0);
+		lv2_atom_forge_int (&h->forge, encoding);
+	}
+	lv2_atom_forge_pop (&h->forge, &frame);
+	h->encoding  = encoding;
+	h->ui_active = on;
+	for (uint32_t c = 0; c < MAX_CHN; ++c) {
+		h->next[c] = -1;
+	}
+	/* the ringbuffer is only written with SPR_ENC_RING, which
+	 * is enabled once per instance, and is empty until then */
+	h->ring_pos = h->pos;
+}
+
+/** queue a ui_state message, enabling DSP-side analysis with n_points, or not */
+static void
+host_dspfft (Host* h, int32_t n_points)
+{
+	LV2_Atom_Forge_Frame frame;
+	lv2_atom_forge_frame_time (&h->forge, 0);
+	x_forge_object (&h->forge, &frame, 1, uris.ui_state);
+	lv2_atom_forge_property_head (&h->forge, uris.dspfft, 0);
+	lv2_atom_forge_int (&h->forge, n_points);
+	lv2_atom_forge_pop (&h->forge, &frame);
+	h->dspfft = n_points > 0;
+}
+
+/** queue a tone monitor configuration, an empty list disables it */
+static void
+host_tones (Host* h, uint32_t n, float const* freq)
+{
+	LV2_Atom_Forge_Frame frame;
+	lv2_atom_forge_frame_time (&h->forge, 0);
+	x_forge_object (&h->forge, &frame, 1, uris.tones);
+	lv2_atom_forge_property_head (&h->forge, uris.tonefreq, 0);
+	lv2_atom_forge_vector (&h->forge, sizeof (float), uris.atom_Float, n, freq);
+	lv2_atom_forge_property_head (&h->forge, uris.tonetime, 0);
+	lv2_atom_forge_float (&h->forge, .05f);
+	lv2_atom_forge_pop (&h->forge, &frame);
+}
+
+/** check raw audio of one channel, at stream position pos */
+static void
+check_raw (Host* h, int32_t c, int64_t pos, uint32_t n, float const* data, bool strict)
+{
+	if (c < 0 || c >= (int32_t)h->n_channels) {
+		fail ("rawaudio: channel %d of %u", c, h->n_channels);
+		return;
+	}
+	if (h->next[c] >= 0 && pos < h->next[c]) {
+		fail ("rawaudio: position %lld, expected >= %lld", (long long)pos, (long long)h->next[c]);
+	} else if (h->next[c] >= 0 && pos > h->next[c] && strict) {
+		fail ("rawaudio: gap at %lld, expected %lld", (long long)pos, (long long)h->next[c]);
+	}
+	const float tolerance = h->encoding == SPR_ENC_BFP ? 1e-4f : 0.f;
+	for (uint32_t i = 0; i < n; ++i) {
+		if (fabsf (data[i] - signal_at (c, h->raw_offset + pos + i)) > tolerance) {
+			fail ("rawaudio: data mismatch at %lld + %u", (long long)pos, i);
+			break;
+		}
+	}
+	h->next[c] = pos + n;
+	h->received[c] += n;
+}
+
+/** read all raw audio from the DSP's ringbuffer, as the UI does.
+ * Audio is dropped when the ringbuffer is full, which is after all
+ * audio that is read here. */
+static void
+check_ring (Host* h, LV2_Atom_Object const* obj)
+{
+	static float    buf[MAX_CHN][32768];
+	float*          d[MAX_CHN];
+	const LV2_Atom* a0 = NULL;
+
+	if (!h->ring) {
+		fail ("ringdata: no ringbuffer interface");
+		return;
+	}
+	if (1 != lv2_atom_object_get (obj, uris.dropped, &a0, NULL) || !a0 || a0->type != uris.atom_Long) {
+		fail ("ringdata: no dropped count");
+		return;
+	}
+	for (uint32_t c = 0; c < MAX_CHN; ++c) {
+		d[c] = buf[c];
+	}
+	uint32_t n = h->ring->read_space (h->instance);
+	if (n > 32768) {
+		fail ("ringdata: %u samples available", n);
+		n = 32768;
+	}
+	n = h->ring->read (h->instance, d, n);
+	for (uint32_t c = 0; c < h->n_channels; ++c) {
+		for (uint32_t i = 0; i < n; ++i) {
+			if (d[c][i] != signal_at (c, h->ring_pos + i)) {
+				fail ("ringdata: data mismatch at %lld + %u", (long long)h->ring_pos, i);
+				break;
+			}
+		}
+	}
+	const int64_t dropped = ((LV2_Atom_Long const*)a0)->body;
+	if (dropped < h->ring_dropped) {
+		fail ("ringdata: dropped count decreased");
+	}
+	h->ring_pos += n + dropped - h->ring_dropped;
+	h->ring_dropped = dropped;
+	h->ring_read += n;
+}
+
+static void
+check_spectrum (Host* h, LV2_Atom_Object const* obj)
+{
+	const LV2_Atom* a0 = NULL;
+	const LV2_Atom* a1 = NULL;
+	lv2_atom_object_get (obj, uris.channelid, &a0, uris.bandpower, &a1, NULL);
+	if (!a0 || a0->type != uris.atom_Int || !a1 || a1->type != uris.atom_Vector) {
+		fail ("spectrum: no channel or data");
+		return;
+	}
+	const int32_t          t = ((LV2_Atom_Int const*)a0)->body;
+	LV2_Atom_Vector const* v = (LV2_Atom_Vector const*)a1;
+	const uint32_t         n = (a1->size - sizeof (LV2_Atom_Vector_Body)) / sizeof (float);
+	if (t < 0 || t >= (int32_t)h->n_traces) {
+		fail ("spectrum: trace %d of %u", t, h->n_traces);
+	}
+	if (v->body.child_type != uris.atom_Float || n == 0 || n > MAX_DSP_POINTS) {
+		fail ("spectrum: %u points", n);
+		return;
+	}
+	float const* p = (float const*)(v + 1);
+	for (uint32_t i = 0; i < n; ++i) {
+		if (!isfinite (p[i])) {
+			fail ("spectrum: point %u is not finite", i);
+			break;
+		}
+	}
+	++h->n_spectra;
+}
+
+static void
+check_tones (Host* h, LV2_Atom_Object const* obj)
+{
+	const LV2_Atom* a0 = NULL;
+	const LV2_Atom* a1 = NULL;
+	lv2_atom_object_get (obj, uris.tonefreq, &a0, uris.tonedb, &a1, NULL);
+	if (!a0 || a0->type != uris.atom_Vector || !a1 || a1->type != uris.atom_Vector || a0->size != a1->size) {
+		fail ("tones: no frequencies or levels");
+		return;
+	}
+	const uint32_t n = (a1->size - sizeof (LV2_Atom_Vector_Body)) / sizeof (float);
+	float const*   p = (float const*)((LV2_Atom_Vector const*)a1 + 1);
+	for (uint32_t i = 0; i < n; ++i) {
+		if (!isfinite (p[i]) || p[i] > 6.f) {
+			fail ("tones: level %u is %f", i, p[i]);
+			break;
+		}
+	}
+	++h->n_tones;
+}
+
+static void
+check_notify (Host* h, uint32_t capacity, bool strict)
+{
+	static float             decoded[MAX_BLOCK];
+	LV2_Atom_Sequence const* seq = (LV2_Atom_Sequence const*)h->notify;
+
+	if (capacity < sizeof (LV2_Atom_Sequence)) {
+		return;
+	}
+	if (seq->atom.size > capacity) {
+		fail ("notify: size %u > capacity %u", seq->atom.size, capacity);
+		return;
+	}
+
+	LV2_ATOM_SEQUENCE_FOREACH (seq, ev)
+	{
+		LV2_Atom_Object const* obj = (LV2_Atom_Object const*)&ev->body;
+		if (obj->atom.type != uris.atom_Object && obj->atom.type != uris.atom_Blank) {
+			continue;
+		}
+		if (obj->body.otype == uris.dspstats) {
+			++h->n_stats;
+			continue;
+		} else if (obj->body.otype == uris.ringdata) {
+			check_ring (h, obj);
+			continue;
+		} else if (obj->body.otype == uris.spectrum) {
+			check_spectrum (h, obj);
+			continue;
+		} else if (obj->body.otype == uris.tonelevel) {
+			check_tones (h, obj);
+			continue;
+		}
+		if (obj->body.otype != uris.rawaudio) {
+			continue;
+		}
+		const LV2_Atom* a0 = NULL;
+		const LV2_Atom* a1 = NULL;
+		const LV2_Atom* a2 = NULL;
+		const LV2_Atom* a3 = NULL;
+		lv2_atom_object_get (obj, uris.channelid, &a0, uris.audiodata, &a1, uris.audiobfp, &a2, uris.framepos, &a3, NULL);
+		if (!a0 || a0->type != uris.atom_Int || !a3 || a3->type != uris.atom_Long) {
+			fail ("rawaudio: no channel or position");
+			continue;
+		}
+		const int32_t c   = ((LV2_Atom_Int const*)a0)->body;
+		const int64_t pos = ((LV2_Atom_Long const*)a3)->body;
+		if (a1 && a1->type == uris.atom_Vector) {
+			LV2_Atom_Vector const* v = (LV2_Atom_Vector const*)a1;
+			const uint32_t         n = (a1->size - sizeof (LV2_Atom_Vector_Body)) / sizeof (float);
+			check_raw (h, c, pos, n, (float const*)(v + 1), strict);
+		} else if (a2 && a2->type == uris.atom_Chunk) {
+			const uint32_t n = bfp_samples (a2->size);
+			if (n > MAX_BLOCK) {
+				fail ("audiobfp: %u samples > %u", n, MAX_BLOCK);
+				continue;
+			}
+			bfp_decode (decoded, (int16_t const*)LV2_ATOM_BODY_CONST (a2), n);
+			check_raw (h, c, pos, n, decoded, strict);
+		} else {
+			fail ("rawaudio: no audio data");
+		}
+	}
+}
+
+/** process one cycle of n_samples with a notify buffer of the given capacity,
+ * returns the time spent in run() [ns] */
+static uint64_t
+host_cycle (Host* h, uint32_t n_samples, uint32_t capacity, bool strict)
+{
+	for (uint32_t c = 0; c < h->n_channels; ++c) {
+		for (uint32_t i = 0; i < n_samples; ++i) {
+			h->in[c][i]  = signal_at (c, h->pos + i);
+			h->out[c][i] = NAN;
+		}
+	}
+
+	/* the input is not silent, all of it is part of the raw audio stream */
+	h->raw_offset = h->pos - h->raw_pos;
+
+	LV2_Atom_Sequence* seq = (LV2_Atom_Sequence*)h->notify;
+	seq->atom.size         = capacity;
+	seq->atom.type         = 0;
+
+	const uint64_t calls = rt_calls;
+	in_rt                = true;
+	const uint64_t t0    = spr_time_ns ();
+	h->desc->run (h->instance, n_samples);
+	const uint64_t dt = spr_time_ns () - t0;
+	in_rt             = false;
+
+	if (rt_calls != calls) {
+		fail ("%s called from run(), %u sample block, capacity %u", rt_culprit, n_samples, capacity);
+	}
+
+	for (uint32_t c = 0; c < h->n_channels; ++c) {
+		if (memcmp (h->in[c], h->out[c], n_samples * sizeof (float))) {
+			fail ("audio not forwarded, %u sample block, capacity %u", n_samples, capacity);
+			break;
+		}
+	}
+
+	if (capacity >= sizeof (LV2_Atom_Sequence) && seq->atom.type != atom_Sequence) {
+		fail ("notify is not a sequence, capacity %u", capacity);
+	} else {
+		check_notify (h, capacity, strict);
+	}
+
+	host_clear_control (h);
+	h->pos += n_samples;
+	if (h->ui_active && !h->dspfft && h->encoding != SPR_ENC_RING) {
+		h->raw_pos += n_samples;
+	}
+
+	/* non-realtime part of the worker */
+	if (work_pending && h->worker) {
+		work_pending = false;
+		resp_size    = 0;
+		h->worker->work (h->instance, work_respond, NULL, work_size, work_msg);
+		if (resp_size > 0) {
+			in_rt = true;
+			h->worker->work_response (h->instance, resp_size, resp_msg);
+			in_rt = false;
+			if (rt_calls != calls) {
+				fail ("%s called from work_response(), %u sample block", rt_culprit, n_samples);
+			}
+		}
+	}
+	return dt;
+}
+
+/******************************************************************************
+ * tests
+ */
+
+static int
+cmp_u64 (const void* a, const void* b)
+{
+	const uint64_t x = *(const uint64_t*)a;
+	const uint64_t y = *(const uint64_t*)b;
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static uint32_t
+next_blocksize (uint32_t n)
+{
+	/* all sizes up to 16, then odd sizes and powers of two */
+	if (n < 16) {
+		return n + 1;
+	}
+	return (n & (n - 1)) ? n + 1 : 2 * n - 1;
+}
+
+/** samples of raw audio received, all channels */
+static uint64_t
+host_received (Host const* h)
+{
+	uint64_t n = 0;
+	for (uint32_t c = 0; c < h->n_channels; ++c) {
+		n += h->received[c];
+	}
+	return n;
+}
+
+typedef enum {
+	M_CLOSED = 0,
+	M_FLOAT,
+	M_BFP,
+	M_RING,
+	M_DSPFFT,
+	M_TONES,
+	M_LAST
+} TestMode;
+
+/** queue the messages to enter or leave a mode */
+static void
+host_mode (Host* h, TestMode m, bool enter)
+{
+	static const float freq[] = { 440, 1000, 5000 };
+	switch (m) {
+		case M_FLOAT:
+		case M_BFP:
+		case M_RING:
+			host_ui (h, enter, m == M_FLOAT ? SPR_ENC_FLOAT : m == M_BFP ? SPR_ENC_BFP : SPR_ENC_RING);
+			break;
+		case M_DSPFFT:
+			host_ui (h, enter, SPR_ENC_FLOAT);
+			host_dspfft (h, enter ? 512 : 0);
+			break;
+		case M_TONES:
+			host_ui (h, enter, SPR_ENC_FLOAT);
+			host_tones (h, enter ? 3 : 0, freq);
+			break;
+		default:
+			break;
+	}
+}
+
+/** every block size with notify buffers of various sizes,
+ * run() must be real-time safe, latency is reported */
+static void
+test_blocksizes (const char* uri)
+{
+	static const uint32_t capacity[] = { 1 << 20, 33024, 8192, 1024, 64, 16 };
+	static const char*    mode[]     = { "UI closed", "float", "bfp", "ring", "dspfft", "tones" };
+	static uint64_t       dt[N_TIMED * (sizeof (capacity) / sizeof (uint32_t))];
+
+	Host h;
+	if (!host_init (&h, uri)) {
+		++n_errors;
+		return;
+	}
+
+	printf ("%s\n", uri);
+	for (TestMode m = M_CLOSED; m < M_LAST; ++m) {
+		host_mode (&h, m, true);
+		host_cycle (&h, 64, 1 << 20, false);
+
+		const uint64_t received  = host_received (&h);
+		const uint64_t ring_read = h.ring_read;
+		const uint64_t n_spectra = h.n_spectra;
+		const uint64_t n_tones   = h.n_tones;
+
+		printf (" %-9s  block   p50[us]   p99[us]   max[us] budget[us]\n", mode[m]);
+		for (uint32_t n = 1; n <= MAX_BLOCK; n = next_blocksize (n)) {
+			uint32_t k = 0;
+			for (uint32_t c = 0; c < sizeof (capacity) / sizeof (uint32_t); ++c) {
+				for (uint32_t i = 0; i < N_TIMED; ++i) {
+					dt[k++] = host_cycle (&h, n, capacity[c], false);
+				}
+			}
+			qsort (dt, k, sizeof (uint64_t), cmp_u64);
+			const double budget = 1e6 * n / RATE;
+			const double p99    = dt[k * 99 / 100] * 1e-3;
+			if (n == 1 || (n & (n - 1)) == 0) {
+				printf ("            %5u %9.2f %9.2f %9.2f %9.2f%s\n",
+				        n, dt[k / 2] * 1e-3, p99, dt[k - 1] * 1e-3, budget,
+				        p99 > budget ? "  (over budget)" : "");
+			}
+		}
+
+		if ((m == M_FLOAT || m == M_BFP || m == M_TONES) && host_received (&h) == received) {
+			fail ("%s: no raw audio", mode[m]);
+		}
+		if (m == M_RING && h.ring_read == ring_read) {
+			fail ("%s: no audio in the ringbuffer", mode[m]);
+		}
+		if (m == M_DSPFFT && h.n_spectra == n_spectra) {
+			fail ("%s: no spectra", mode[m]);
+		}
+		if (m == M_TONES && h.n_tones == n_tones) {
+			fail ("%s: no tone levels", mode[m]);
+		}
+		printf ("            received %llu raw, %llu ringbuffer samples, %llu spectra, %llu tone levels\n",
+		        (unsigned long long)(host_received (&h) - received), (unsigned long long)(h.ring_read - ring_read),
+		        (unsigned long long)(h.n_spectra - n_spectra), (unsigned long long)(h.n_tones - n_tones));
+
+		host_mode (&h, m, false);
+		host_cycle (&h, 64, 1 << 20, false);
+	}
+	host_cleanup (&h);
+}
+
+/** raw audio must be delivered. If the notify buffer fits every cycle,
+ * completely, otherwise only collected audio may be discarded.
+ * This spans several statistics reports, which are optional */
+static void
+test_capacity (const char* uri, uint32_t encoding, uint32_t n_samples, uint32_t capacity, bool complete, bool stats)
+{
+	Host h;
+	if (!host_init (&h, uri)) {
+		++n_errors;
+		return;
+	}
+	printf ("%s %s, %u sample blocks, notify capacity %u\n", uri,
+	        encoding == SPR_ENC_BFP ? "bfp" : "float", n_samples, capacity);
+
+	host_ui (&h, true, encoding);
+	host_cycle (&h, 64, 1 << 20, false);
+	const uint32_t errors = n_errors;
+	const int64_t  start  = h.raw_pos;
+	for (uint32_t c = 0; c < h.n_channels; ++c) {
+		h.received[c] = 0;
+	}
+	/* ~ 10 seconds */
+	for (uint32_t i = 0; i < 10 * RATE / n_samples; ++i) {
+		host_cycle (&h, n_samples, capacity, complete);
+	}
+	const int64_t n_raw = h.raw_pos - start;
+	for (uint32_t c = 0; c < h.n_channels; ++c) {
+		/* collected audio of the last cycle may still be pending */
+		if (h.next[c] < start || h.raw_pos - h.next[c] > MAX_BLOCK) {
+			fail ("raw audio stalled at %lld of %lld", (long long)h.next[c], (long long)h.raw_pos);
+		}
+		if (h.received[c] < (complete ? n_raw - MAX_BLOCK : n_raw * .9)) {
+			fail ("received %llu of %lld samples", (unsigned long long)h.received[c], (long long)n_raw);
+		}
+	}
+	if (stats && h.n_stats == 0) {
+		fail ("no statistics in %lld samples", (long long)n_raw);
+	}
+	printf ("  %s, received %.1f%% of raw audio and %llu statistics reports\n",
+	        errors == n_errors ? "OK" : "FAILED", 100. * h.received[0] / n_raw, (unsigned long long)h.n_stats);
+	host_cleanup (&h);
+}
+
+/* FFTW wisdom is saved to a cache file, see ft_wisdom_file() */
+static char cache_dir[] = "/tmp/x42-spectr-check.XXXXXX";
+
+static void
+cache_cleanup (void)
+{
+	DIR* dir = opendir (cache_dir);
+	if (dir) {
+		char           path[1024];
+		struct dirent* de;
+		while ((de = readdir (dir))) {
+			if (strcmp (de->d_name, ".") && strcmp (de->d_name, "..")) {
+				snprintf (path, sizeof (path), "%s/%s", cache_dir, de->d_name);
+				unlink (path);
+			}
+		}
+		closedir (dir);
+	}
+	rmdir (cache_dir);
+}
+
+int
+main (int argc, char** argv)
+{
+	if (!mkdtemp (cache_dir)) {
+		fprintf (stderr, "cannot create a temporary cache directory\n");
+		return 1;
+	}
+	atexit (cache_cleanup);
+	setenv ("XDG_CACHE_HOME", cache_dir, 1);
+	setenv ("LOCALAPPDATA", cache_dir, 1);
+
+	signal_init ();
+	map_spectra_uris (&map, &uris);
+	atom_Sequence = uri_to_id (NULL, LV2_ATOM__Sequence);
+
+	test_blocksizes (SPR_URI "#Mono");
+	test_blocksizes (SPR_URI "#Stereo");
+	test_blocksizes (SPR_URI "#Quad");
+
+	/* raw audio and statistics fit */
+	test_capacity (SPR_URI "#Mono", SPR_ENC_FLOAT, 8192, 1 << 20, true, true);
+	test_capacity (SPR_URI "#Stereo", SPR_ENC_BFP, 4096, 33024, true, true);
+	test_capacity (SPR_URI "#Stereo", SPR_ENC_BFP, 256, 8192, true, true);
+	test_capacity (SPR_URI "#Quad", SPR_ENC_FLOAT, 4096, 131328, true, true);
+	/* raw audio fits (32936 bytes), but not with statistics. Every few cycles
+	 * an additional chunk of collected audio would be due, which is discarded */
+	test_capacity (SPR_URI "#Mono", SPR_ENC_FLOAT, 8192, 33024, false, false);
+
+	printf ("%s, %u error(s)\n", n_errors ? "FAILED" : "PASSED", n_errors);
+	return n_errors ? 1 : 0;
+}